@@ -0,0 +1,47 @@
+# We use GCC/Clang's function multi-versioning for AVX512
+# support. This code will automatically dispatch to the
+# AVX512 IFMA modpow algorithm if the CPU supports it and
+# use the default (portable) algorithm otherwise.
+
+include(CheckCXXSourceCompiles)
+include(CMakePushCheckState)
+
+cmake_push_check_state()
+set(CMAKE_REQUIRED_INCLUDES "${PROJECT_SOURCE_DIR}")
+
+check_cxx_source_compiles("
+    #include <src/cpu_supports_avx512_ifma.hpp>
+    #include <immintrin.h>
+    #include <stdint.h>
+
+    __attribute__ ((target (\"avx512f,avx512ifma\")))
+    void madd52_x86_avx512(uint64_t* res)
+    {
+        __m512i x = _mm512_set1_epi64(123);
+        __m512i lo = _mm512_madd52lo_epu64(_mm512_setzero_si512(), x, x);
+        __m512i hi = _mm512_madd52hi_epu64(_mm512_setzero_si512(), x, x);
+        _mm512_storeu_si512(res, _mm512_add_epi64(lo, hi));
+    }
+
+    void madd52_default(uint64_t* res)
+    {
+        for (int i = 0; i < 8; i++)
+            res[i] = 123 * 123;
+    }
+
+    int main()
+    {
+        uint64_t res[8];
+        if (cpu_supports_avx512_ifma)
+            madd52_x86_avx512(res);
+        else
+            madd52_default(res);
+        return 0;
+    }
+" multiarch_avx512_ifma)
+
+if(multiarch_avx512_ifma)
+    list(APPEND PRIMECOUNT_COMPILE_DEFINITIONS "ENABLE_MULTIARCH_AVX512_IFMA")
+endif()
+
+cmake_pop_check_state()
@@ -10,10 +10,12 @@
 
 #include "CmdOptions.hpp"
 #include "calculator.hpp"
-#include "int128_t.hpp"
+#include "shard.hpp"
+#include "uint256_t.hpp"
 
 #include <cstddef>
 #include <cctype>
+#include <cmath>
 #include <map>
 #include <stdint.h>
 #include <stdexcept>
@@ -27,11 +29,24 @@ namespace {
 
 enum OptionID
 {
+  OPTION_AFFINITY,
   OPTION_DISTANCE,
+  OPTION_ENGINE,
   OPTION_HELP,
+  OPTION_MAX_MEMORY,
+  OPTION_MERGE,
+  OPTION_NUMA,
   OPTION_NUMBER,
+  OPTION_PERF_COUNTERS,
+  OPTION_PHYSICAL_CORES,
+  OPTION_PIPELINE,
   OPTION_PRINT,
+  OPTION_PSEUDOSQUARES,
+  OPTION_SHARD,
+  OPTION_SIEVING_PRIMES,
   OPTION_THREADS,
+  OPTION_TRACE,
+  OPTION_TUNE,
   OPTION_VERSION
 };
 
@@ -196,8 +211,8 @@ T getVal(const Option& opt)
 
 void CmdOptions::optionDistance(Option& opt)
 {
-  uint128_t start = 0;
-  uint128_t val = getVal<uint128_t>(opt);
+  uint256_t start = 0;
+  uint256_t val = getVal<uint256_t>(opt);
 
   if (!numbers.empty())
     start = numbers.front();
@@ -215,6 +230,57 @@ void CmdOptions::optionDistance(Option& opt)
   }
 }
 
+void CmdOptions::optionEngine(Option& opt)
+{
+  if (opt.val == "auto")
+    engine = ENGINE_AUTO;
+  else if (opt.val == "primesieve")
+    engine = ENGINE_PRIMESIEVE;
+  else if (opt.val == "pseudosquares")
+    engine = ENGINE_PSEUDOSQUARES;
+  else
+    throw std::runtime_error("invalid option '" + opt.opt + "=" + opt.val + "'");
+}
+
+/// Memory size in bytes, e.g. 512M, 4GiB, 1.5G.
+/// The units K, M, G, T are powers of 1024.
+///
+void CmdOptions::optionMaxMemory(Option& opt)
+{
+  std::size_t pos = opt.val.find_first_not_of("0123456789.");
+  std::string number = opt.val.substr(0, pos);
+  std::string unit = (pos == std::string::npos) ? "" : opt.val.substr(pos);
+  const std::string units = "KMGT";
+  double bytes = 0;
+
+  try {
+    std::size_t len = 0;
+    bytes = std::stod(number, &len);
+    if (len != number.size())
+      throw std::runtime_error("");
+  }
+  catch (std::exception&) {
+    throw std::runtime_error("invalid option '" + opt.opt + "=" + opt.val + "'");
+  }
+
+  if (!unit.empty() && unit != "B")
+  {
+    std::size_t i = units.find((char) std::toupper((unsigned char) unit[0]));
+    std::string suffix = unit.substr(1);
+
+    if (i == std::string::npos ||
+        (!suffix.empty() && suffix != "B" && suffix != "iB"))
+      throw std::runtime_error("invalid option '" + opt.opt + "=" + opt.val + "'");
+
+    bytes *= std::pow(1024.0, (double) i + 1);
+  }
+
+  if (bytes < 1 || bytes >= 1.8e19)
+    throw std::runtime_error("invalid option '" + opt.opt + "=" + opt.val + "'");
+
+  max_memory = (uint64_t) bytes;
+}
+
 CmdOptions parseOptions(int argc, char** argv)
 {
   // No command-line options provided
@@ -224,15 +290,28 @@ CmdOptions parseOptions(int argc, char** argv)
   /// Command-line options
   const std::map<std::string, std::pair<OptionID, IsParam>> optionMap =
   {
+    { "--affinity", std::make_pair(OPTION_AFFINITY, NO_PARAM) },
     { "-d",        std::make_pair(OPTION_DISTANCE, REQUIRED_PARAM) },
     { "--dist",    std::make_pair(OPTION_DISTANCE, REQUIRED_PARAM) },
+    { "--engine",  std::make_pair(OPTION_ENGINE, REQUIRED_PARAM) },
     { "-h",        std::make_pair(OPTION_HELP, NO_PARAM) },
     { "--help",    std::make_pair(OPTION_HELP, NO_PARAM) },
+    { "--max-memory", std::make_pair(OPTION_MAX_MEMORY, REQUIRED_PARAM) },
+    { "--merge",   std::make_pair(OPTION_MERGE, OPTIONAL_PARAM) },
+    { "--numa",    std::make_pair(OPTION_NUMA, NO_PARAM) },
     { "--number",  std::make_pair(OPTION_NUMBER, REQUIRED_PARAM) },
     { "-p",        std::make_pair(OPTION_PRINT, OPTIONAL_PARAM) },
+    { "--perf-counters", std::make_pair(OPTION_PERF_COUNTERS, NO_PARAM) },
+    { "--physical-cores", std::make_pair(OPTION_PHYSICAL_CORES, NO_PARAM) },
+    { "--pipeline", std::make_pair(OPTION_PIPELINE, OPTIONAL_PARAM) },
     { "--print",   std::make_pair(OPTION_PRINT, OPTIONAL_PARAM) },
+    { "--pseudosquares", std::make_pair(OPTION_PSEUDOSQUARES, REQUIRED_PARAM) },
+    { "--shard",   std::make_pair(OPTION_SHARD, REQUIRED_PARAM) },
+    { "--sieving-primes", std::make_pair(OPTION_SIEVING_PRIMES, REQUIRED_PARAM) },
     { "-t",        std::make_pair(OPTION_THREADS, REQUIRED_PARAM) },
     { "--threads", std::make_pair(OPTION_THREADS, REQUIRED_PARAM) },
+    { "--trace",   std::make_pair(OPTION_TRACE, REQUIRED_PARAM) },
+    { "--tune",    std::make_pair(OPTION_TUNE, OPTIONAL_PARAM) },
     { "-v",        std::make_pair(OPTION_VERSION, NO_PARAM) },
     { "--version", std::make_pair(OPTION_VERSION, NO_PARAM) }
   };
@@ -246,11 +325,26 @@ CmdOptions parseOptions(int argc, char** argv)
 
     switch (optionID)
     {
+      case OPTION_AFFINITY: opts.affinity = AFFINITY_CORES; break;
       case OPTION_DISTANCE: opts.optionDistance(opt); break;
-      case OPTION_NUMBER:   opts.numbers.push_back(getVal<uint128_t>(opt));
+      case OPTION_ENGINE:   opts.optionEngine(opt); break;
+      case OPTION_MAX_MEMORY: opts.optionMaxMemory(opt); break;
+      case OPTION_MERGE:    opts.merge = true;
+                            opts.merge_file = opt.val; break;
+      case OPTION_NUMA:     opts.affinity = AFFINITY_NUMA; break;
+      case OPTION_NUMBER:   opts.numbers.push_back(getVal<uint256_t>(opt));
                             opts.numbers_str.push_back(opt.val); break;
+      case OPTION_PERF_COUNTERS: opts.perf_counters = true; break;
+      case OPTION_PHYSICAL_CORES: opts.physical_cores = true; break;
+      case OPTION_PIPELINE: opts.pipeline = opt.val.empty() ? PIPELINE_AUTO : getVal<int>(opt); break;
       case OPTION_PRINT:    opts.print_primes = true; break;
+      case OPTION_PSEUDOSQUARES: opts.pseudosquares_file = opt.val; break;
+      case OPTION_SHARD:    parse_shard(opt.val, opts.shard_index, opts.shards); break;
+      case OPTION_SIEVING_PRIMES: opts.sieving_primes_file = opt.val; break;
       case OPTION_THREADS:  opts.threads = getVal<int>(opt); break;
+      case OPTION_TRACE:    opts.trace_file = opt.val; break;
+      case OPTION_TUNE:     opts.tune = true;
+                            opts.tune_file = opt.val; break;
       case OPTION_HELP:     help(0); break;
       case OPTION_VERSION:  version(); break;
     }
@@ -11,8 +11,10 @@
 #ifndef CMDOPTIONS_HPP
 #define CMDOPTIONS_HPP
 
-#include "int128_t.hpp"
+#include "pseudosquares_prime_sieve.hpp"
+#include "uint256_t.hpp"
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -30,13 +32,30 @@ struct Option
 
 struct CmdOptions
 {
-  std::vector<uint128_t> numbers;
+  std::vector<uint256_t> numbers;
   std::vector<std::string> numbers_str;
   std::string optionStr;
+  std::string pseudosquares_file;
+  std::string sieving_primes_file;
+  std::string merge_file;
+  std::string trace_file;
+  std::string tune_file;
   int option = -1;
   int threads = 0;
+  uint64_t shard_index = 0;
+  uint64_t shards = 0;
+  uint64_t max_memory = 0;
+  int pipeline = PIPELINE_OFF;
+  Affinity affinity = AFFINITY_NONE;
+  Engine engine = ENGINE_AUTO;
+  bool perf_counters = false;
+  bool physical_cores = false;
+  bool merge = false;
+  bool tune = false;
   bool print_primes = false;
   void optionDistance(Option& opt);
+  void optionEngine(Option& opt);
+  void optionMaxMemory(Option& opt);
 };
 
 CmdOptions parseOptions(int, char**);
@@ -0,0 +1,203 @@
+///
+/// @file   Montgomery96.hpp
+/// @brief  Montgomery modular arithmetic for odd moduli
+///         2^64 < n < 2^96. Sieving primes near 10^20 - 10^28
+///         requires moduli of this size. Compared to generic
+///         128-bit Montgomery arithmetic we save partial
+///         products since the upper word of all operands is
+///         < 2^33: the product of the upper words fits into
+///         128 bits without carries and the Montgomery
+///         reduction (REDC) needs only 2 word-sized steps,
+///         each with a 64-bit and a 32-bit partial product.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef MONTGOMERY96_HPP
+#define MONTGOMERY96_HPP
+
+#include "int128_t.hpp"
+#include "macros.hpp"
+
+#include <stdint.h>
+
+namespace {
+
+/// Values are stored in Montgomery form x * R mod n with
+/// R = 2^128. Since 4n < R we use lazy reduction: all
+/// values are in [0, 2n) and only converted to [0, n)
+/// by convert_out().
+///
+class Montgomery96
+{
+public:
+    Montgomery96(uint128_t n)
+        : n_(n),
+          n0_((uint64_t) n),
+          n1_((uint64_t) (n >> 64))
+    {
+        ASSERT(n % 2 == 1);
+        ASSERT(n < ((uint128_t) 1 << 96));
+
+        // Newton's iteration doubles the number of
+        // correct bits of n^-1 mod 2^64 each step.
+        uint64_t inv = n0_;
+        for (int i = 0; i < 5; i++)
+            inv *= 2 - n0_ * inv;
+        ninv_ = 0 - inv;
+
+        // R mod n = (2^128 - n) mod n
+        r_ = (0 - n) % n;
+    }
+
+    static constexpr uint128_t max_modulus()
+    {
+        return ((uint128_t) 1 << 96) - 1;
+    }
+
+    /// x * y * R^-1 mod n, x, y < 2n
+    ALWAYS_INLINE uint128_t multiply(uint128_t x, uint128_t y) const
+    {
+        uint64_t x0 = (uint64_t) x;
+        uint64_t x1 = (uint64_t) (x >> 64);
+        uint64_t y0 = (uint64_t) y;
+        uint64_t y1 = (uint64_t) (y >> 64);
+
+        // x * y = lo + mid * 2^64 + hi * 2^128
+        uint128_t lo = (uint128_t) x0 * y0;
+        uint128_t mid = (uint128_t) x0 * y1 + (uint128_t) x1 * y0;
+        uint128_t hi = (uint128_t) x1 * y1;
+
+        return redc(lo, mid, hi);
+    }
+
+    /// x^2 * R^-1 mod n, x < 2n
+    ALWAYS_INLINE uint128_t square(uint128_t x) const
+    {
+        uint64_t x0 = (uint64_t) x;
+        uint64_t x1 = (uint64_t) (x >> 64);
+
+        uint128_t lo = (uint128_t) x0 * x0;
+        uint128_t mid = ((uint128_t) x0 * x1) << 1;
+        uint128_t hi = (uint128_t) x1 * x1;
+
+        return redc(lo, mid, hi);
+    }
+
+    /// (x + y) mod 2n, x, y < 2n
+    ALWAYS_INLINE uint128_t add(uint128_t x, uint128_t y) const
+    {
+        uint128_t sum = x + y;
+        uint128_t n2 = n_ << 1;
+        if (sum >= n2)
+            sum -= n2;
+        return sum;
+    }
+
+    /// Convert a small integer into Montgomery form
+    uint128_t convert_in(uint64_t x) const
+    {
+        // x * (R mod n) < 2^64 * 2^96 would overflow,
+        // but our bases are small primes.
+        ASSERT(x < (1 << 30));
+        return (x * r_) % n_;
+    }
+
+    /// Convert out of Montgomery form into [0, n)
+    uint128_t convert_out(uint128_t x) const
+    {
+        uint128_t res = redc(x, 0, 0);
+        if (res >= n_)
+            res -= n_;
+        return res;
+    }
+
+    /// 2^e mod n in Montgomery form. Multiplying by 2
+    /// is a modular addition, hence this is faster
+    /// than pow().
+    ///
+    uint128_t two_pow(uint128_t e) const
+    {
+        if (e == 0)
+            return r_;
+
+        // The leading 5 bits of the exponent are
+        // handled without squaring: 2^v * R mod n
+        // with v < 32.
+        int bits = 128 - count_leading_zeros(e);
+        int shift = (bits > 5) ? bits - 5 : 0;
+        uint64_t v = (uint64_t) (e >> shift);
+        uint128_t res = (r_ << v) % n_;
+
+        for (int i = shift - 1; i >= 0; i--)
+        {
+            res = square(res);
+            if ((e >> i) & 1)
+                res = add(res, res);
+        }
+
+        return res;
+    }
+
+    /// base^e mod n in Montgomery form
+    uint128_t pow(uint128_t base, uint128_t e) const
+    {
+        uint128_t res = r_;
+
+        for (int i = 127 - count_leading_zeros(e); i >= 0; i--)
+        {
+            res = square(res);
+            if ((e >> i) & 1)
+                res = multiply(res, base);
+        }
+
+        return res;
+    }
+
+private:
+    uint128_t n_;
+    uint64_t n0_;
+    uint64_t n1_;
+    uint64_t ninv_;
+    // R mod n
+    uint128_t r_;
+
+    /// Number of leading zero bits, e > 0
+    static int count_leading_zeros(uint128_t e)
+    {
+        uint64_t hi = (uint64_t) (e >> 64);
+        if (hi)
+            return __builtin_clzll(hi);
+        else
+            return 64 + __builtin_clzll((uint64_t) e);
+    }
+
+    /// Montgomery reduction of t = lo + mid * 2^64 + hi * 2^128
+    /// with t < 4n^2. Returns t * R^-1 mod n in [0, 2n).
+    ///
+    ALWAYS_INLINE uint128_t redc(uint128_t lo, uint128_t mid, uint128_t hi) const
+    {
+        // t = t0 + t1 * 2^64 + hi * 2^128
+        uint64_t t0 = (uint64_t) lo;
+        uint128_t t1 = (lo >> 64) + mid;
+
+        // 1st step: (t + m0 * n) / 2^64
+        uint64_t m0 = t0 * ninv_;
+        uint128_t c0 = ((uint128_t) m0 * n0_ + t0) >> 64;
+        uint128_t u = c0 + t1 + (uint128_t) m0 * n1_;
+
+        // 2nd step: (u + m1 * n) / 2^64
+        uint64_t u0 = (uint64_t) u;
+        uint64_t m1 = u0 * ninv_;
+        uint128_t c1 = ((uint128_t) m1 * n0_ + u0) >> 64;
+
+        return c1 + (u >> 64) + hi + (uint128_t) m1 * n1_;
+    }
+};
+
+} // namespace
+
+#endif
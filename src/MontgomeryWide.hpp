@@ -0,0 +1,213 @@
+///
+/// @file   MontgomeryWide.hpp
+/// @brief  Montgomery modular arithmetic for odd moduli with
+///         N 64-bit words (e.g. 192-bit and 256-bit). This is
+///         used for moduli > 2^126 which are not supported by
+///         the hurchalla/modular_arithmetic library.
+///
+///         Multiplication uses the CIOS (Coarsely Integrated
+///         Operand Scanning) algorithm from: C. K. Koc, T. Acar,
+///         B. S. Kaliski, "Analyzing and comparing Montgomery
+///         multiplication algorithms", IEEE Micro, 1996.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef MONTGOMERYWIDE_HPP
+#define MONTGOMERYWIDE_HPP
+
+#include "int128_t.hpp"
+#include "macros.hpp"
+#include "uint256_t.hpp"
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace {
+
+/// Values are stored in Montgomery form x * R mod n with
+/// R = 2^(64 * N). The modulus must be odd and < R / 4
+/// so that modular additions cannot overflow.
+///
+template <std::size_t N>
+class MontgomeryWide
+{
+public:
+    using T = WideUint<N>;
+
+    MontgomeryWide(const T& n)
+        : n_(n)
+    {
+        ASSERT(n.word(0) % 2 == 1);
+        ASSERT(n.bit_length() <= N * 64 - 2);
+
+        // Newton's iteration doubles the number of
+        // correct bits of n^-1 mod 2^64 each step.
+        uint64_t n0 = n.word(0);
+        uint64_t inv = n0;
+        for (int i = 0; i < 5; i++)
+            inv *= 2 - n0 * inv;
+        ninv_ = 0 - inv;
+
+        // one_ = R mod n. We start with the largest power
+        // of 2 < n and double it until we reach R, this
+        // requires only a few iterations since n fills
+        // (nearly) all N words.
+        std::size_t bits = n.bit_length() - 1;
+        one_ = T(1) << bits;
+        for (; bits < N * 64; bits++)
+            one_ = add(one_, one_);
+
+        minus_one_ = n_ - one_;
+    }
+
+    const T& modulus() const
+    {
+        return n_;
+    }
+
+    /// Montgomery form of 1
+    const T& one() const
+    {
+        return one_;
+    }
+
+    /// Montgomery form of n - 1
+    const T& minus_one() const
+    {
+        return minus_one_;
+    }
+
+    /// (x + y) mod n
+    ALWAYS_INLINE T add(const T& x, const T& y) const
+    {
+        T sum = x + y;
+        if (sum >= n_)
+            sum -= n_;
+        return sum;
+    }
+
+    /// x * y * R^-1 mod n
+    ALWAYS_INLINE T multiply(const T& x, const T& y) const
+    {
+        uint64_t t[N + 2] = {};
+
+        for (std::size_t i = 0; i < N; i++)
+        {
+            // t += x * y[i]
+            uint64_t carry = 0;
+            uint64_t yi = y.word(i);
+
+            for (std::size_t j = 0; j < N; j++)
+            {
+                uint128_t p = (uint128_t) x.word(j) * yi + t[j] + carry;
+                t[j] = (uint64_t) p;
+                carry = (uint64_t) (p >> 64);
+            }
+
+            uint128_t sum = (uint128_t) t[N] + carry;
+            t[N] = (uint64_t) sum;
+            t[N + 1] = (uint64_t) (sum >> 64);
+
+            // t = (t + m * n) / 2^64
+            uint64_t m = t[0] * ninv_;
+            uint128_t p = (uint128_t) m * n_.word(0) + t[0];
+            carry = (uint64_t) (p >> 64);
+
+            for (std::size_t j = 1; j < N; j++)
+            {
+                p = (uint128_t) m * n_.word(j) + t[j] + carry;
+                t[j - 1] = (uint64_t) p;
+                carry = (uint64_t) (p >> 64);
+            }
+
+            sum = (uint128_t) t[N] + carry;
+            t[N - 1] = (uint64_t) sum;
+            t[N] = t[N + 1] + (uint64_t) (sum >> 64);
+        }
+
+        // Since n < R / 4 the result is < 2n
+        // and t[N] is always 0.
+        ASSERT(t[N] == 0);
+        T res;
+        for (std::size_t i = 0; i < N; i++)
+            res.word(i) = t[i];
+        if (res >= n_)
+            res -= n_;
+
+        return res;
+    }
+
+    ALWAYS_INLINE T square(const T& x) const
+    {
+        return multiply(x, x);
+    }
+
+    /// Convert a small integer into Montgomery form
+    T convert_in(uint64_t x) const
+    {
+        ASSERT(x < n_);
+        T res = 0;
+        T pow2 = one_;
+
+        for (; x > 0; x >>= 1)
+        {
+            if (x & 1)
+                res = add(res, pow2);
+            pow2 = add(pow2, pow2);
+        }
+
+        return res;
+    }
+
+    T convert_out(const T& x) const
+    {
+        return multiply(x, T(1));
+    }
+
+    /// 2^e mod n in Montgomery form. Multiplying by 2
+    /// is a modular addition, hence this is faster
+    /// than pow().
+    ///
+    T two_pow(const T& e) const
+    {
+        T res = one_;
+
+        for (std::size_t i = e.bit_length(); i-- > 0;)
+        {
+            res = square(res);
+            if ((e.word(i / 64) >> (i % 64)) & 1)
+                res = add(res, res);
+        }
+
+        return res;
+    }
+
+    /// base^e mod n in Montgomery form
+    T pow(const T& base, const T& e) const
+    {
+        T res = one_;
+
+        for (std::size_t i = e.bit_length(); i-- > 0;)
+        {
+            res = square(res);
+            if ((e.word(i / 64) >> (i % 64)) & 1)
+                res = multiply(res, base);
+        }
+
+        return res;
+    }
+
+private:
+    T n_;
+    T one_;
+    T minus_one_;
+    uint64_t ninv_;
+};
+
+} // namespace
+
+#endif
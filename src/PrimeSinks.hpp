@@ -0,0 +1,75 @@
+///
+/// @file  PrimeSinks.hpp
+/// @brief A sink receives the primes of each sieve segment in
+///        increasing order as one batch: sink(primes, size).
+///        The sieve is a template that is specialized for each
+///        sink type, hence counting, printing and storing primes
+///        do not branch on a runtime flag for each prime.
+///        User-defined sinks are passed as CallbackSink which
+///        costs one indirect call per segment.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef PRIMESINKS_HPP
+#define PRIMESINKS_HPP
+
+#include "int128_t.hpp"
+#include "uint256_t.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// Only counts the primes. For segments that do not require
+/// the Pseudosquares Prime Test the sieve counts the set bits
+/// of the sieve array instead of extracting the primes.
+///
+struct CountSink
+{
+    template <typename T>
+    void operator()(const T*, std::size_t) const
+    { }
+};
+
+/// Prints the primes to the standard output, one
+/// write per segment.
+///
+struct PrintSink
+{
+    template <typename T>
+    void operator()(const T* primes, std::size_t size) const
+    {
+        std::string str;
+
+        for (std::size_t i = 0; i < size; i++)
+        {
+            str += to_string(primes[i]);
+            str += '\n';
+        }
+
+        std::cout << str;
+    }
+};
+
+/// Appends the primes to a std::vector
+template <typename T>
+struct VectorSink
+{
+    std::vector<T>& primes;
+
+    void operator()(const T* batch, std::size_t size) const
+    {
+        primes.insert(primes.end(), batch, batch + size);
+    }
+};
+
+template <typename T>
+using CallbackSink = std::function<void(const T* primes, std::size_t size)>;
+
+#endif
@@ -16,6 +16,7 @@
 #include "macros.hpp"
 #include "Vector.hpp"
 
+#include <cstring>
 #include <stdint.h>
 
 namespace {
@@ -33,6 +34,15 @@ public:
         return size_;
     }
 
+    /// Reuse the sieve array for another segment
+    /// size, the memory is only ever grown.
+    ///
+    void resize(std::size_t size)
+    {
+        size_ = size;
+        sieve_.resize((size + 15) / 16);
+    }
+
     static std::size_t numbers_per_byte()
     {
         return 16;
@@ -55,7 +65,110 @@ public:
         sieve_[i >> 4] &= unset_bit_[i & 15];
     }
 
+    /// Count the set bits of the odd numbers at
+    /// sieve[first], sieve[first + 2], ... < sieve[stop]
+    /// with first = 0 or 1.
+    ///
+    uint64_t count(std::size_t first, std::size_t stop) const
+    {
+        ASSERT(first <= 1);
+        ASSERT(stop <= size_);
+        if (stop <= first)
+            return 0;
+
+        std::size_t bits = (stop - first + 1) / 2;
+        std::size_t words = bits / 64;
+        const uint8_t* sieve = sieve_.data();
+        uint64_t count = 0;
+
+        for (std::size_t i = 0; i < words; i++)
+        {
+            uint64_t word;
+            std::memcpy(&word, &sieve[i * 8], sizeof(word));
+            count += popcount64(word);
+        }
+
+        for (std::size_t i = words * 64; i < bits; i++)
+            count += (sieve[i >> 3] >> (i & 7)) & 1;
+
+        return count;
+    }
+
+    /// Call f(i) for each set bit of the odd numbers at
+    /// sieve[first], sieve[first + 2], ... < sieve[stop]
+    /// with first = 0 or 1. Processes 64 bits at once,
+    /// most bits are unset after sieving.
+    ///
+    template <typename F>
+    void for_each_bit(std::size_t first, std::size_t stop, F f) const
+    {
+        ASSERT(first <= 1);
+        ASSERT(stop <= size_);
+        if (stop <= first)
+            return;
+
+        std::size_t bits = (stop - first + 1) / 2;
+        std::size_t words = bits / 64;
+        const uint8_t* sieve = sieve_.data();
+
+        for (std::size_t i = 0; i < words; i++)
+        {
+            uint64_t word = load64(&sieve[i * 8]);
+
+            for (; word != 0; word &= word - 1)
+                f(first + (i * 64 + ctz64(word)) * 2);
+        }
+
+        for (std::size_t i = words * 64; i < bits; i++)
+            if ((sieve[i >> 3] >> (i & 7)) & 1)
+                f(first + i * 2);
+    }
+
 private:
+    /// Bit i of the result is bit (i & 7) of
+    /// bytes[i >> 3], on both little and big
+    /// endian CPUs.
+    ///
+    static ALWAYS_INLINE uint64_t load64(const uint8_t* bytes)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+
+#if defined(__BYTE_ORDER__) && \
+    defined(__ORDER_BIG_ENDIAN__) && \
+    __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+
+        return word;
+    }
+
+    static ALWAYS_INLINE uint64_t popcount64(uint64_t x)
+    {
+#if __has_builtin(__builtin_popcountll)
+        return (uint64_t) __builtin_popcountll(x);
+#else
+        x = x - ((x >> 1) & 0x5555555555555555ull);
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return (x * 0x0101010101010101ull) >> 56;
+#endif
+    }
+
+    /// Requires x != 0
+    static ALWAYS_INLINE uint64_t ctz64(uint64_t x)
+    {
+        ASSERT(x != 0);
+#if __has_builtin(__builtin_ctzll)
+        return (uint64_t) __builtin_ctzll(x);
+#else
+        uint64_t count = 0;
+        for (; (x & 1) == 0; x >>= 1)
+            count++;
+        return count;
+#endif
+    }
+
     std::size_t size_;
     Vector<uint8_t> sieve_;
     static const Array<std::size_t, 16> is_bit_;
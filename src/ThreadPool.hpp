@@ -0,0 +1,119 @@
+///
+/// @file  ThreadPool.hpp
+/// @brief Persistent thread pool which is reused by all calls of
+///        pseudosquares_prime_sieve_parallel(). Creating threads
+///        for each query is expensive for short intervals and
+///        the threads keep their warm sieve state (sieving
+///        primes, sieve array) between queries.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+class ThreadPool
+{
+public:
+    ThreadPool() = default;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+
+        cond_.notify_all();
+        for (std::thread& thread : threads_)
+            thread.join();
+    }
+
+    /// The number of threads only ever grows
+    void reserve(std::size_t threads)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (threads_.size() < threads)
+            threads_.emplace_back([this]() { worker(); });
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return threads_.size();
+    }
+
+    /// Call f(i, thread) for each of the pool's threads
+    template <typename F>
+    void for_each_thread(F&& f)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::size_t i = 0; i < threads_.size(); i++)
+            f(i, threads_[i]);
+    }
+
+    /// Run task() on one of the pool's threads
+    template <typename F>
+    std::future<decltype(std::declval<F>()())> submit(F&& task)
+    {
+        using R = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+        std::future<R> future = packaged->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back([packaged]() { (*packaged)(); });
+        }
+
+        cond_.notify_one();
+        return future;
+    }
+
+private:
+    void worker()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty())
+                    return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::function<void()>> tasks_;
+    std::vector<std::thread> threads_;
+    bool stop_ = false;
+};
+
+} // namespace
+
+#endif
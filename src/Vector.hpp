@@ -10,6 +10,7 @@
 #ifndef VECTOR_HPP
 #define VECTOR_HPP
 
+#include "arena.hpp"
 #include "macros.hpp"
 
 #include <algorithm>
@@ -30,14 +31,17 @@ namespace {
 /// checks in release builds which is important for our sieve's
 /// performance, e.g. the Fedora Linux distribution compiles with
 /// -D_GLIBCXX_ASSERTIONS which enables std::vector bounds checks.
+/// By default the memory is allocated from the current thread's
+/// arena (see arena.hpp) which aligns the memory to a cache line
+/// and uses transparent huge pages for large arrays.
 ///
 template <typename T,
-          typename Allocator = std::allocator<T>>
+          typename Allocator = ArenaAllocator<T>>
 class Vector
 {
 public:
-  // The default C++ std::allocator is stateless. We use this
-  // allocator and do not support other statefull allocators,
+  // The default C++ std::allocator and our ArenaAllocator are
+  // stateless. We do not support other statefull allocators,
   // which simplifies our implementation.
   //
   // "The default allocator is stateless, that is, all instances
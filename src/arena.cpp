@@ -0,0 +1,226 @@
+///
+/// @file  arena.cpp
+/// @brief Each thread caches up to max_blocks freed blocks of
+///        at least min_cached_bytes, if the cache is full the
+///        least recently freed block is deleted. An allocation
+///        reuses the smallest cached block that fits and that
+///        wastes less than half of its memory. The block sizes
+///        are rounded up to a multiple of the cache line size
+///        (or huge page size) so that blocks of nearly the same
+///        size are interchangeable. Note that a recycled block
+///        may be larger than the size its new owner passes to
+///        arena_deallocate(), the excess memory is then simply
+///        not reused until the block is freed.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#include "arena.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <stdint.h>
+
+#if defined(__linux__)
+  #include <sys/mman.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <sys/resource.h>
+#endif
+
+namespace {
+
+const std::size_t cache_line_size = 64;
+const std::size_t huge_page_size = 2 << 20;
+const std::size_t min_cached_bytes = 64 << 10;
+const std::size_t max_blocks = 16;
+
+/// Set using arena_set_max_cached()
+std::atomic<std::size_t> max_cached_bytes(arena_default_max_cached);
+std::size_t get_alignment(std::size_t bytes)
+{
+    return (bytes >= huge_page_size) ? huge_page_size : cache_line_size;
+}
+
+std::size_t round_up(std::size_t bytes)
+{
+    std::size_t alignment = get_alignment(bytes);
+    std::size_t rem = bytes % alignment;
+    return (rem == 0) ? bytes : bytes + (alignment - rem);
+}
+
+void* new_block(std::size_t bytes)
+{
+    std::size_t alignment = get_alignment(bytes);
+    void* ptr = ::operator new(bytes, std::align_val_t(alignment));
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // Fewer TLB misses when crossing off multiples in
+    // multi-MiB sieve arrays. This is only a hint, if
+    // transparent huge pages are disabled we continue
+    // using regular pages.
+    if (alignment == huge_page_size)
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+
+    return ptr;
+}
+
+void delete_block(void* ptr, std::size_t bytes) noexcept
+{
+    ::operator delete(ptr, std::align_val_t(get_alignment(bytes)));
+}
+
+struct Block
+{
+    void* ptr;
+    std::size_t bytes;
+};
+
+/// Never allocates itself, hence it can
+/// be used from arena_deallocate().
+///
+class Arena
+{
+public:
+    ~Arena()
+    {
+        for (std::size_t i = 0; i < size_; i++)
+            delete_block(blocks_[i].ptr, blocks_[i].bytes);
+
+        exited = true;
+    }
+
+    void* allocate(std::size_t bytes)
+    {
+        std::size_t best = size_;
+
+        // Blocks must be deleted with the
+        // alignment they were allocated with.
+        for (std::size_t i = 0; i < size_; i++)
+            if (blocks_[i].bytes >= bytes &&
+                blocks_[i].bytes / 2 < bytes &&
+                get_alignment(blocks_[i].bytes) == get_alignment(bytes) &&
+                (best == size_ || blocks_[i].bytes < blocks_[best].bytes))
+                best = i;
+
+        if (best == size_)
+            return new_block(bytes);
+
+        void* ptr = blocks_[best].ptr;
+        cached_bytes_ -= blocks_[best].bytes;
+        for (std::size_t i = best + 1; i < size_; i++)
+            blocks_[i - 1] = blocks_[i];
+        size_--;
+        return ptr;
+    }
+
+    /// Returns false if the block is not cached.
+    /// If the cache is full the oldest blocks
+    /// are deleted.
+    ///
+    bool recycle(void* ptr, std::size_t bytes) noexcept
+    {
+        std::size_t max_cached = max_cached_bytes.load(std::memory_order_relaxed);
+
+        if (bytes > max_cached)
+            return false;
+
+        while (size_ >= max_blocks ||
+               cached_bytes_ + bytes > max_cached)
+        {
+            delete_block(blocks_[0].ptr, blocks_[0].bytes);
+            cached_bytes_ -= blocks_[0].bytes;
+            for (std::size_t i = 1; i < size_; i++)
+                blocks_[i - 1] = blocks_[i];
+            size_--;
+        }
+
+        blocks_[size_++] = Block{ptr, bytes};
+        cached_bytes_ += bytes;
+        return true;
+    }
+
+    /// Set when the thread's arena has been destroyed,
+    /// blocks that are freed afterwards (e.g. by the
+    /// destructors of static objects) are deleted.
+    static thread_local bool exited;
+
+private:
+    std::array<Block, max_blocks> blocks_;
+    std::size_t size_ = 0;
+    std::size_t cached_bytes_ = 0;
+};
+
+thread_local bool Arena::exited = false;
+
+Arena* get_arena()
+{
+    if (Arena::exited)
+        return nullptr;
+
+    thread_local Arena arena;
+    return &arena;
+}
+
+} // namespace
+
+void* arena_allocate(std::size_t bytes)
+{
+    bytes = round_up(bytes);
+
+    if (bytes >= min_cached_bytes)
+    {
+        Arena* arena = get_arena();
+        if (arena)
+            return arena->allocate(bytes);
+    }
+
+    return new_block(bytes);
+}
+
+void arena_deallocate(void* ptr, std::size_t bytes) noexcept
+{
+    if (!ptr)
+        return;
+
+    bytes = round_up(bytes);
+
+    if (bytes >= min_cached_bytes)
+    {
+        Arena* arena = get_arena();
+        if (arena && arena->recycle(ptr, bytes))
+            return;
+    }
+
+    delete_block(ptr, bytes);
+}
+
+void arena_set_max_cached(std::size_t bytes)
+{
+    max_cached_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+uint64_t get_peak_memory()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+  #if defined(__APPLE__)
+    // macOS reports bytes
+    return (uint64_t) usage.ru_maxrss;
+  #else
+    // Linux & BSD report kilobytes
+    return (uint64_t) usage.ru_maxrss * 1024;
+  #endif
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,92 @@
+///
+/// @file  arena.hpp
+/// @brief Per-thread arena used by Vector. All allocations are
+///        aligned to a cache line, allocations >= 2 MiB are
+///        aligned to the huge page size and backed by
+///        transparent huge pages (Linux). Freed blocks are kept
+///        in a small per-thread cache, hence the sieve arrays,
+///        sieving primes and candidate buffers that are
+///        repeatedly allocated by reused contexts and thread
+///        pool tasks do not go back to malloc.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+
+void* arena_allocate(std::size_t bytes);
+
+/// Memory may be freed by any thread, it is then
+/// recycled by the arena of the freeing thread.
+///
+void arena_deallocate(void* ptr, std::size_t bytes) noexcept;
+
+/// Maximum number of bytes of freed blocks that each
+/// thread's arena keeps in its cache, reduced to fit
+/// into the --max-memory budget.
+///
+void arena_set_max_cached(std::size_t bytes);
+
+/// Peak resident memory (RSS) of the process in bytes,
+/// returns 0 if not supported by the operating system.
+///
+uint64_t get_peak_memory();
+
+namespace {
+
+const std::size_t arena_default_max_cached = 256 << 20;
+
+/// Stateless allocator (all instances share the
+/// current thread's arena) as required by Vector.
+///
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    ArenaAllocator() noexcept = default;
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) noexcept
+    { }
+
+    T* allocate(std::size_t n)
+    {
+        if (n > std::size_t(-1) / sizeof(T))
+            throw std::bad_alloc();
+
+        return static_cast<T*>(arena_allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept
+    {
+        arena_deallocate(ptr, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>&) const noexcept
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>&) const noexcept
+    {
+        return false;
+    }
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,62 @@
+///
+/// @file  cpu_cache_size.cpp
+/// @brief Detect the CPU's L1 data cache size and the number of
+///        SMT threads per CPU core using primesieve's
+///        CpuInfo class. This is a separate translation unit
+///        because primesieve's Vector.hpp and our Vector.hpp
+///        use the same include guard.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#include "cpu_cache_size.hpp"
+
+#if defined(ENABLE_PRIMESIEVE_CPUINFO)
+  #include <CpuInfo.hpp>
+#endif
+
+#include <algorithm>
+#include <stdint.h>
+#include <string>
+
+/// Same as primesieve's Erat::getL1CacheSize()
+uint64_t get_l1_cache_size()
+{
+    // Default L1 data cache size if it cannot be detected
+    uint64_t l1_cache_size = 32 << 10;
+
+#if defined(ENABLE_PRIMESIEVE_CPUINFO)
+    if (primesieve::cpuInfo.hasL1Cache())
+        l1_cache_size = primesieve::cpuInfo.l1CacheBytes();
+#endif
+
+    l1_cache_size = std::max(l1_cache_size, (uint64_t) 16 << 10);
+    l1_cache_size = std::min(l1_cache_size, (uint64_t) 8192 << 10);
+    return l1_cache_size;
+}
+
+/// Returns 1 if unknown
+uint64_t get_l1_cache_sharing()
+{
+    uint64_t l1_sharing = 1;
+
+#if defined(ENABLE_PRIMESIEVE_CPUINFO)
+    if (primesieve::cpuInfo.hasL1Sharing())
+        l1_sharing = primesieve::cpuInfo.l1Sharing();
+#endif
+
+    return std::max(l1_sharing, (uint64_t) 1);
+}
+
+/// Returns an empty string if unknown
+std::string get_cpu_name()
+{
+#if defined(ENABLE_PRIMESIEVE_CPUINFO)
+    return primesieve::cpuInfo.cpuName();
+#else
+    return std::string();
+#endif
+}
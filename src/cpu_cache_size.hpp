@@ -0,0 +1,27 @@
+///
+/// @file  cpu_cache_size.hpp
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef CPU_CACHE_SIZE_HPP
+#define CPU_CACHE_SIZE_HPP
+
+#include <stdint.h>
+#include <string>
+
+/// L1 data cache size of the current CPU in bytes
+uint64_t get_l1_cache_size();
+
+/// Number of logical CPU cores sharing the L1 data cache,
+/// i.e. the number of SMT threads per physical CPU core.
+///
+uint64_t get_l1_cache_sharing();
+
+/// Name of the current CPU, empty if unknown
+std::string get_cpu_name();
+
+#endif
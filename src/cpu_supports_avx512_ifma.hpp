@@ -0,0 +1,119 @@
+///
+/// @file  cpu_supports_avx512_ifma.hpp
+/// @brief Detect if the x86 CPU supports AVX512 IFMA.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef CPU_SUPPORTS_AVX512_IFMA_HPP
+#define CPU_SUPPORTS_AVX512_IFMA_HPP
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+  #include <immintrin.h>
+#endif
+
+// CPUID bits documentation:
+// https://en.wikipedia.org/wiki/CPUID
+
+// %ebx bit flags
+#define bit_AVX512F    (1 << 16)
+#define bit_AVX512IFMA (1 << 21)
+
+// %ecx bit flags
+#define bit_OSXSAVE (1 << 27)
+
+// xgetbv bit flags
+#define XSTATE_SSE (1 << 1)
+#define XSTATE_YMM (1 << 2)
+#define XSTATE_ZMM (7 << 5)
+
+namespace {
+
+void run_cpuid(int eax, int ecx, int* abcd)
+{
+#if defined(_MSC_VER)
+  __cpuidex(abcd, eax, ecx);
+#else
+  int ebx = 0;
+  int edx = 0;
+
+  #if defined(__i386__) && \
+      defined(__PIC__)
+    // In case of PIC under 32-bit EBX cannot be clobbered
+    __asm__ __volatile__("movl %%ebx, %%edi;"
+                         "cpuid;"
+                         "xchgl %%ebx, %%edi;"
+                         : "+a" (eax),
+                           "=D" (ebx),
+                           "+c" (ecx),
+                           "=d" (edx));
+  #else
+    __asm__ __volatile__("cpuid"
+                         : "+a" (eax),
+                           "+b" (ebx),
+                           "+c" (ecx),
+                           "=d" (edx));
+  #endif
+
+  abcd[0] = eax;
+  abcd[1] = ebx;
+  abcd[2] = ecx;
+  abcd[3] = edx;
+#endif
+}
+
+// Get Value of Extended Control Register
+uint64_t get_xcr0()
+{
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t eax;
+  uint32_t edx;
+
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return eax | (uint64_t(edx) << 32);
+#endif
+}
+
+bool has_cpuid_avx512_ifma()
+{
+  int abcd[4];
+
+  run_cpuid(1, 0, abcd);
+
+  // Ensure OS supports extended processor state management
+  if ((abcd[2] & bit_OSXSAVE) != bit_OSXSAVE)
+    return false;
+
+  uint64_t ymm_mask = XSTATE_SSE | XSTATE_YMM;
+  uint64_t zmm_mask = XSTATE_SSE | XSTATE_YMM | XSTATE_ZMM;
+  uint64_t xcr0 = get_xcr0();
+
+  // Check AVX OS support
+  if ((xcr0 & ymm_mask) != ymm_mask)
+    return false;
+
+  // Check AVX512 OS support
+  if ((xcr0 & zmm_mask) != zmm_mask)
+    return false;
+
+  run_cpuid(7, 0, abcd);
+
+  // modpow_x86_avx512_ifma() requires AVX512F & AVX512IFMA
+  return ((abcd[1] & bit_AVX512F) == bit_AVX512F &&
+          (abcd[1] & bit_AVX512IFMA) == bit_AVX512IFMA);
+}
+
+/// Initialized at startup
+const bool cpu_supports_avx512_ifma = has_cpuid_avx512_ifma();
+
+} // namespace
+
+#endif
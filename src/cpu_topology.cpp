@@ -0,0 +1,347 @@
+///
+/// @file  cpu_topology.cpp
+/// @brief Detect the NUMA nodes, the number of CPUs available
+///        to this process and pin threads to CPUs. On Linux
+///        the topology is read from sysfs and the CPU quota
+///        from the cgroup filesystem, hence we do not depend
+///        on libnuma. On other operating systems no topology
+///        is detected and threads are not pinned.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#include "cpu_topology.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+  #include <fstream>
+  #include <pthread.h>
+  #include <sched.h>
+  #include <sstream>
+#endif
+
+namespace {
+
+#if defined(__linux__)
+
+/// Parse a sysfs CPU list e.g. "0-3,8-11"
+std::vector<int> parse_cpu_list(const std::string& str)
+{
+    std::vector<int> cpus;
+    std::istringstream iss(str);
+    std::string range;
+
+    while (std::getline(iss, range, ','))
+    {
+        if (range.empty() || range[0] == '\n')
+            continue;
+
+        std::size_t pos = range.find('-');
+        int first = std::stoi(range.substr(0, pos));
+        int last = (pos == std::string::npos) ? first : std::stoi(range.substr(pos + 1));
+
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+std::string read_line(const std::string& filename)
+{
+    std::ifstream file(filename);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+/// Index of the CPU within its physical core,
+/// 0 for the first SMT sibling.
+///
+int get_smt_index(int cpu)
+{
+    std::string filename = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list";
+
+    try {
+        std::vector<int> siblings = parse_cpu_list(read_line(filename));
+        auto iter = std::find(siblings.begin(), siblings.end(), cpu);
+        if (iter != siblings.end())
+            return (int) (iter - siblings.begin());
+    }
+    catch (const std::exception&) { }
+
+    return 0;
+}
+
+/// Order the CPUs such that the first SMT sibling of
+/// each physical core comes first, hence pinned threads
+/// only share a physical core once all cores are used.
+///
+void sort_by_smt_index(std::vector<int>& cpus)
+{
+    std::vector<std::pair<int, int>> order;
+
+    for (int cpu : cpus)
+        order.emplace_back(get_smt_index(cpu), cpu);
+
+    std::sort(order.begin(), order.end());
+
+    for (std::size_t i = 0; i < cpus.size(); i++)
+        cpus[i] = order[i].second;
+}
+
+std::vector<std::vector<int>> detect_numa_nodes()
+{
+    std::vector<std::vector<int>> nodes;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return nodes;
+
+    for (int node = 0; node < 4096; node++)
+    {
+        std::string filename = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        std::ifstream file(filename);
+
+        if (!file)
+        {
+            // Node ids may have gaps
+            if (node < 64)
+                continue;
+            break;
+        }
+
+        std::string line;
+        std::getline(file, line);
+        std::vector<int> cpus;
+
+        try {
+            for (int cpu : parse_cpu_list(line))
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+        }
+        catch (const std::exception&) {
+            cpus.clear();
+        }
+
+        if (!cpus.empty())
+            nodes.push_back(cpus);
+    }
+
+    // Kernel without NUMA support
+    if (nodes.empty())
+    {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &allowed))
+                cpus.push_back(cpu);
+        if (!cpus.empty())
+            nodes.push_back(cpus);
+    }
+
+    for (std::vector<int>& cpus : nodes)
+        sort_by_smt_index(cpus);
+
+    return nodes;
+}
+
+/// CPU limit of a cgroup directory and its ancestors, e.g.
+/// cgroup v2 "cpu.max" = "1600000 100000" -> 16 CPUs.
+/// Returns 0 if there is no limit.
+///
+int get_cgroup_dir_cpu_limit(const std::string& root, std::string path, bool v2)
+{
+    int limit = 0;
+
+    while (true)
+    {
+        std::string dir = root + path;
+        double quota = -1;
+        double period = 0;
+
+        try {
+            if (v2)
+            {
+                // "max 100000" if unlimited
+                std::istringstream iss(read_line(dir + "/cpu.max"));
+                std::string max;
+                if (iss >> max >> period && max != "max")
+                    quota = std::stod(max);
+            }
+            else
+            {
+                std::string cfs_quota = read_line(dir + "/cpu.cfs_quota_us");
+                std::string cfs_period = read_line(dir + "/cpu.cfs_period_us");
+                if (!cfs_quota.empty() && !cfs_period.empty())
+                {
+                    quota = std::stod(cfs_quota);
+                    period = std::stod(cfs_period);
+                }
+            }
+        }
+        catch (const std::exception&) {
+            quota = -1;
+        }
+
+        if (quota > 0 && period > 0)
+        {
+            int cpus = (int) std::max(1.0, std::ceil(quota / period));
+            limit = (limit > 0) ? std::min(limit, cpus) : cpus;
+        }
+
+        if (path.empty() || path == "/")
+            return limit;
+
+        std::size_t pos = path.find_last_of('/');
+        path = (pos == std::string::npos) ? "" : path.substr(0, pos);
+    }
+}
+
+int detect_available_cpus()
+{
+    int cpus = 0;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        cpus = CPU_COUNT(&allowed);
+
+    int limit = get_cgroup_cpu_limit("/proc/self/cgroup", "/sys/fs/cgroup");
+    if (limit > 0)
+        cpus = (cpus > 0) ? std::min(cpus, limit) : limit;
+
+    return cpus;
+}
+
+#endif
+
+} // namespace
+
+const std::vector<std::vector<int>>& get_numa_nodes()
+{
+#if defined(__linux__)
+    static const std::vector<std::vector<int>> nodes = detect_numa_nodes();
+#else
+    static const std::vector<std::vector<int>> nodes;
+#endif
+    return nodes;
+}
+
+int get_available_cpus()
+{
+#if defined(__linux__)
+    static const int cpus = detect_available_cpus();
+#else
+    static const int cpus = 0;
+#endif
+    return cpus;
+}
+
+/// Each line of /proc/self/cgroup has the format
+/// "hierarchy-ID:controller-list:cgroup-path". The cgroup
+/// v2 line is "0::/path".
+///
+int get_cgroup_cpu_limit(const std::string& cgroup_file,
+                         const std::string& cgroup_root)
+{
+#if defined(__linux__)
+    std::ifstream file(cgroup_file);
+    std::string line;
+    int limit = 0;
+
+    while (std::getline(file, line))
+    {
+        std::size_t pos1 = line.find(':');
+        std::size_t pos2 = line.find(':', pos1 + 1);
+        if (pos1 == std::string::npos || pos2 == std::string::npos)
+            continue;
+
+        std::string id = line.substr(0, pos1);
+        std::string controllers = line.substr(pos1 + 1, pos2 - pos1 - 1);
+        std::string path = line.substr(pos2 + 1);
+        std::vector<int> limits;
+
+        if (id == "0" && controllers.empty())
+            limits.push_back(get_cgroup_dir_cpu_limit(cgroup_root, path, true));
+        else if (("," + controllers + ",").find(",cpu,") != std::string::npos)
+        {
+            limits.push_back(get_cgroup_dir_cpu_limit(cgroup_root + "/cpu", path, false));
+            limits.push_back(get_cgroup_dir_cpu_limit(cgroup_root + "/cpu,cpuacct", path, false));
+            limits.push_back(get_cgroup_dir_cpu_limit(cgroup_root + "/cpuacct,cpu", path, false));
+        }
+
+        for (int cpus : limits)
+            if (cpus > 0)
+                limit = (limit > 0) ? std::min(limit, cpus) : cpus;
+    }
+
+    return limit;
+#else
+    (void) cgroup_file;
+    (void) cgroup_root;
+    return 0;
+#endif
+}
+
+int get_current_numa_node()
+{
+#if defined(__linux__)
+    int cpu = sched_getcpu();
+    const std::vector<std::vector<int>>& nodes = get_numa_nodes();
+
+    for (std::size_t node = 0; node < nodes.size(); node++)
+        for (int node_cpu : nodes[node])
+            if (node_cpu == cpu)
+                return (int) node;
+#endif
+
+    return 0;
+}
+
+bool pin_thread(std::thread& thread, int cpu)
+{
+#if defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(cpuset), &cpuset) == 0;
+#else
+    (void) thread;
+    (void) cpu;
+    return false;
+#endif
+}
+
+bool unpin_thread(std::thread& thread)
+{
+#if defined(__linux__)
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+
+    for (const std::vector<int>& cpus : get_numa_nodes())
+        for (int cpu : cpus)
+            CPU_SET(cpu, &cpuset);
+
+    if (CPU_COUNT(&cpuset) == 0)
+        return false;
+
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(cpuset), &cpuset) == 0;
+#else
+    (void) thread;
+    return false;
+#endif
+}
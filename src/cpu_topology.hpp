@@ -0,0 +1,54 @@
+///
+/// @file  cpu_topology.hpp
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef CPU_TOPOLOGY_HPP
+#define CPU_TOPOLOGY_HPP
+
+#include <string>
+#include <thread>
+#include <vector>
+
+/// The CPUs of each NUMA node that this process is allowed
+/// to run on, the first SMT sibling of each physical core
+/// comes first. Nodes without allowed CPUs are skipped.
+/// Returns an empty vector if the topology cannot be detected.
+///
+const std::vector<std::vector<int>>& get_numa_nodes();
+
+/// Number of CPUs this process may use: the CPUs of its
+/// affinity mask, limited by the cgroup (v1 or v2) CPU
+/// quota e.g. inside a container. Returns 0 if unknown.
+///
+int get_available_cpus();
+
+/// CPU quota of the cgroups listed in cgroup_file (format
+/// of /proc/self/cgroup), the cgroup filesystem is mounted
+/// at cgroup_root (e.g. /sys/fs/cgroup). The minimum quota
+/// of each cgroup and its ancestors is used, rounded up.
+/// Returns 0 if there is no limit.
+///
+int get_cgroup_cpu_limit(const std::string& cgroup_file,
+                         const std::string& cgroup_root);
+
+/// Index (into get_numa_nodes()) of the NUMA node
+/// of the current thread's CPU, 0 if unknown.
+///
+int get_current_numa_node();
+
+/// Pin the thread to a single CPU, returns false if
+/// thread affinity is not supported.
+///
+bool pin_thread(std::thread& thread, int cpu);
+
+/// Allow the thread to run on all CPUs of get_numa_nodes()
+/// again, returns false if thread affinity is not supported.
+///
+bool unpin_thread(std::thread& thread);
+
+#endif
@@ -0,0 +1,377 @@
+///
+/// @file  host_profile.cpp
+/// @brief For each magnitude n we first calibrate the interval
+///        size so that sieving [n, n + len] takes about 0.1
+///        seconds. Then the parameters are tuned one after
+///        another (coordinate descent), starting from the
+///        default heuristics. A parameter is only changed if
+///        this is more than 3% faster, timing noise should
+///        not replace the default heuristics.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#include "host_profile.hpp"
+#include "calculator.hpp"
+#include "cpu_cache_size.hpp"
+#include "int128_t.hpp"
+#include "pseudosquares_prime_sieve.hpp"
+#include "Sieve.hpp"
+
+#if defined(ENABLE_MULTIARCH_AVX512_IFMA)
+  #include "cpu_supports_avx512_ifma.hpp"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/// Each band is tuned at n and used for stop <= max_stop
+struct Magnitude
+{
+    double n;
+    double max_stop;
+};
+
+const Magnitude magnitudes[] =
+{
+    { 1e13, 1e16 },
+    { 1e19, 1e22 },
+    { 1e25, 1e28 },
+    { 1e31, std::numeric_limits<double>::max() }
+};
+
+/// Default heuristics, see pseudosquares_prime_sieve.cpp
+ProfileBand default_band(double n)
+{
+    ProfileBand band;
+    band.max_stop = std::numeric_limits<double>::max();
+    band.sieve_size = 256 << 10;
+    band.min_thread_dist = std::max(1e4, std::pow(n, 1.0 / 5.0));
+    band.avx512_ifma = true;
+    return band;
+}
+
+/// Fastest of 2 runs in seconds
+double measure(PseudosquaresSieve& sieve,
+               const ProfileBand& band,
+               uint128_t start,
+               uint128_t stop)
+{
+    using Clock = std::chrono::steady_clock;
+    using Seconds = std::chrono::duration<double>;
+
+    set_host_profile({ band });
+    double seconds = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < 2; i++)
+    {
+        auto t1 = Clock::now();
+        sieve.count(start, stop);
+        auto t2 = Clock::now();
+        seconds = std::min(seconds, Seconds(t2 - t1).count());
+    }
+
+    return seconds;
+}
+
+/// Fastest of 2 runs in seconds of sieving [start, stop]
+/// using the given number of threads, each thread sieves
+/// (stop - start) / threads numbers.
+///
+double measure_threads(uint128_t start,
+                       uint128_t stop,
+                       int threads)
+{
+    using Clock = std::chrono::steady_clock;
+    using Seconds = std::chrono::duration<double>;
+
+    double seconds = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < 2; i++)
+    {
+        auto t1 = Clock::now();
+        pseudosquares_prime_sieve_parallel(start, stop, threads, nullptr, false, ENGINE_PSEUDOSQUARES);
+        auto t2 = Clock::now();
+        seconds = std::min(seconds, Seconds(t2 - t1).count());
+    }
+
+    return seconds;
+}
+
+/// Keep the parameter value of the fastest run
+template <typename T>
+void tune(PseudosquaresSieve& sieve,
+          ProfileBand& best,
+          double& best_seconds,
+          T ProfileBand::* param,
+          const std::vector<T>& values,
+          uint128_t start,
+          uint128_t stop)
+{
+    for (const T& value : values)
+    {
+        if (value == best.*param)
+            continue;
+
+        ProfileBand band = best;
+        band.*param = value;
+        double seconds = measure(sieve, band, start, stop);
+
+        // Confirm using a new measurement of the best
+        // parameters, the CPU clock rate may have changed.
+        if (seconds < best_seconds * 0.97)
+        {
+            best_seconds = std::min(best_seconds, measure(sieve, best, start, stop));
+            if (seconds < best_seconds * 0.97)
+            {
+                best = band;
+                best_seconds = seconds;
+            }
+        }
+    }
+}
+
+ProfileBand tune_band(const Magnitude& magnitude, bool verbose)
+{
+    PseudosquaresSieve sieve;
+    ProfileBand best = default_band(magnitude.n);
+    uint128_t start = (uint128_t) magnitude.n;
+    uint64_t len = 1 << 16;
+    double best_seconds;
+
+    // Calibrate the interval size
+    while (true)
+    {
+        best_seconds = measure(sieve, best, start, start + len);
+        if (best_seconds >= 0.1 || len >= (uint64_t(1) << 32))
+            break;
+        double factor = (best_seconds > 0) ? 0.12 / best_seconds : 16;
+        factor = std::min(std::max(factor, 2.0), 16.0);
+        len = (uint64_t) (len * factor);
+    }
+
+    uint128_t stop = start + len;
+    best_seconds = std::min(best_seconds, measure(sieve, best, start, stop));
+
+#if defined(ENABLE_MULTIARCH_AVX512_IFMA)
+    if (cpu_supports_avx512_ifma)
+        tune(sieve, best, best_seconds, &ProfileBand::avx512_ifma, { false }, start, stop);
+#endif
+
+    // The sieve size only matters if the interval is sieved
+    // using multiple segments. For large n the segment size
+    // is usually s / log(s) instead, see initialize().
+    std::vector<uint64_t> sieve_sizes;
+    for (uint64_t size = 32 << 10; size <= (4 << 20); size *= 2)
+        if (size * Sieve::numbers_per_byte() * 2 <= len)
+            sieve_sizes.push_back(size);
+
+    tune(sieve, best, best_seconds, &ProfileBand::sieve_size, sieve_sizes, start, stop);
+
+    // Each thread first sets up its interval (chooses s,
+    // generates its sieving primes and computes their first
+    // multiples). A thread's interval should be large enough
+    // so that this setup takes at most about 10% of the
+    // thread's time. Then sieving 2 * dist numbers using 2
+    // threads takes at most 0.55x the time of 1 thread. We
+    // use the smallest such dist, without a 2nd CPU core (or
+    // if 2 threads never pay off) we keep the default.
+    set_host_profile({ best });
+
+    if (std::thread::hardware_concurrency() >= 2)
+    {
+        for (double dist = 1e4; dist <= len; dist *= 4)
+        {
+            uint128_t high = start + (uint64_t) (dist * 2) - 1;
+            double seconds1 = measure_threads(start, high, 1);
+            double seconds2 = measure_threads(start, high, 2);
+
+            if (seconds2 <= seconds1 * 0.55)
+            {
+                best.min_thread_dist = dist;
+                break;
+            }
+        }
+    }
+
+    best.max_stop = magnitude.max_stop;
+
+    if (verbose)
+    {
+        std::cout << "n = " << magnitude.n
+                  << ": interval " << len
+                  << ", sieve_size " << best.sieve_size
+                  << ", min_thread_dist " << (uint64_t) best.min_thread_dist
+                  << ", avx512_ifma " << best.avx512_ifma
+                  << std::fixed << std::setprecision(3)
+                  << ", seconds " << best_seconds << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    return best;
+}
+
+template <typename T>
+T parse_value(const std::string& key, const std::string& value)
+{
+    try {
+        return calculator::eval<T>(value);
+    }
+    catch (const std::exception&) {
+        throw std::runtime_error("profile: invalid " + key + " = '" + value + "'");
+    }
+}
+
+double parse_double(const std::string& key, const std::string& value)
+{
+    try {
+        return std::stod(value);
+    }
+    catch (const std::exception&) {
+        throw std::runtime_error("profile: invalid " + key + " = '" + value + "'");
+    }
+}
+
+} // namespace
+
+std::string get_profile_path()
+{
+    const char* path = std::getenv("PSEUDOSQUARES_PROFILE");
+    if (path && *path)
+        return path;
+
+    const char* home = std::getenv("HOME");
+    if (!home || !*home)
+        home = std::getenv("USERPROFILE");
+    if (!home || !*home)
+        return std::string();
+
+    return std::string(home) + "/.pseudosquares_prime_sieve_profile";
+}
+
+HostProfile tune_host_profile(bool verbose)
+{
+    HostProfile profile;
+    profile.cpu = get_cpu_name();
+
+    if (verbose)
+        std::cout << "CPU: " << (profile.cpu.empty() ? "unknown" : profile.cpu) << std::endl;
+
+    try {
+        for (const Magnitude& magnitude : magnitudes)
+            profile.bands.push_back(tune_band(magnitude, verbose));
+    }
+    catch (...) {
+        set_host_profile({});
+        throw;
+    }
+
+    set_host_profile(profile.bands);
+    return profile;
+}
+
+void write_profile(const std::string& filename, const HostProfile& profile)
+{
+    std::ofstream file(filename);
+
+    if (!file)
+        throw std::runtime_error("profile: failed to create " + filename);
+
+    file << "# pseudosquares_prime_sieve host profile, created by --tune\n";
+    file << "cpu=" << profile.cpu << "\n";
+    file << std::setprecision(17);
+
+    for (const ProfileBand& band : profile.bands)
+        file << "max_stop=" << band.max_stop
+             << " sieve_size=" << band.sieve_size
+             << " min_thread_dist=" << band.min_thread_dist
+             << " avx512_ifma=" << band.avx512_ifma << "\n";
+
+    if (!file.flush())
+        throw std::runtime_error("profile: failed to write " + filename);
+}
+
+HostProfile read_profile(const std::string& filename)
+{
+    std::ifstream file(filename);
+
+    if (!file)
+        throw std::runtime_error("profile: failed to open " + filename);
+
+    HostProfile profile;
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        if (line.compare(0, 4, "cpu=") == 0)
+        {
+            profile.cpu = line.substr(4);
+            continue;
+        }
+
+        std::istringstream iss(line);
+        std::string field;
+        ProfileBand band;
+        int fields = 0;
+
+        while (iss >> field)
+        {
+            std::size_t pos = field.find('=');
+            if (pos == std::string::npos)
+                throw std::runtime_error("profile: invalid line '" + line + "'");
+
+            std::string key = field.substr(0, pos);
+            std::string value = field.substr(pos + 1);
+            fields++;
+
+            if (key == "max_stop") band.max_stop = parse_double(key, value);
+            else if (key == "sieve_size") band.sieve_size = parse_value<uint64_t>(key, value);
+            else if (key == "min_thread_dist") band.min_thread_dist = parse_double(key, value);
+            else if (key == "avx512_ifma") band.avx512_ifma = parse_value<uint64_t>(key, value) != 0;
+            else
+                fields--;
+        }
+
+        if (fields != 4)
+            throw std::runtime_error("profile: incomplete line '" + line + "'");
+
+        profile.bands.push_back(band);
+    }
+
+    return profile;
+}
+
+bool load_host_profile(const std::string& filename)
+{
+    if (filename.empty() ||
+        !std::ifstream(filename))
+        return false;
+
+    HostProfile profile = read_profile(filename);
+
+    if (profile.cpu != get_cpu_name())
+        return false;
+
+    set_host_profile(profile.bands);
+    return true;
+}
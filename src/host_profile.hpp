@@ -0,0 +1,54 @@
+///
+/// @file  host_profile.hpp
+/// @brief The sieve size, the minimum interval size per thread
+///        and the modpow kernel are heuristics.
+///        --tune measures the fastest parameters on the current
+///        host for a few magnitudes and saves them in a profile
+///        file, later runs load the profile automatically.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef HOST_PROFILE_HPP
+#define HOST_PROFILE_HPP
+
+#include "pseudosquares_prime_sieve.hpp"
+
+#include <string>
+#include <vector>
+
+struct HostProfile
+{
+    // The profile is only used on the same CPU model
+    std::string cpu;
+    std::vector<ProfileBand> bands;
+};
+
+/// $PSEUDOSQUARES_PROFILE if set, else the file
+/// .pseudosquares_prime_sieve_profile in the home directory.
+/// Returns an empty string if there is no home directory.
+///
+std::string get_profile_path();
+
+/// Run the tuning experiments on the current host, this
+/// takes a few seconds. Must not be called while sieving.
+///
+HostProfile tune_host_profile(bool verbose);
+
+/// File format, one line per magnitude band:
+/// cpu=<CPU name>
+/// max_stop=1e+16 sieve_size=262144 min_thread_dist=10000 avx512_ifma=1
+///
+void write_profile(const std::string& filename, const HostProfile& profile);
+HostProfile read_profile(const std::string& filename);
+
+/// Calls set_host_profile() if the profile file exists and
+/// it has been created on the same CPU model. Returns false
+/// if the profile has not been loaded.
+///
+bool load_host_profile(const std::string& filename);
+
+#endif
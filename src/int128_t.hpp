@@ -10,6 +10,8 @@
 #ifndef INT128_T_HPP
 #define INT128_T_HPP
 
+#include "macros.hpp"
+
 #include <stdint.h>
 #include <algorithm>
 #include <ostream>
@@ -112,4 +114,37 @@ inline std::ostream& operator<<(std::ostream& stream, uint128_t n)
 
 #endif
 
+namespace {
+
+/// (hi * 2^64 + lo) % d with hi < d. On x64 this is a single
+/// 128-bit by 64-bit divq instruction, whereas the compiler
+/// generates a call to a 128-bit division function.
+///
+ALWAYS_INLINE uint64_t mod_u64(uint64_t hi, uint64_t lo, uint64_t d)
+{
+  ASSERT(hi < d);
+
+#if defined(__x86_64__) && \
+    (defined(__GNUC__) || defined(__clang__))
+  uint64_t q;
+  uint64_t r;
+  __asm__("divq %4" : "=a"(q), "=d"(r) : "a"(lo), "d"(hi), "rm"(d));
+  (void) q;
+  return r;
+#else
+  return (uint64_t) ((((uint128_t) hi << 64) | lo) % d);
+#endif
+}
+
+/// n % d using 64-bit reductions
+ALWAYS_INLINE uint64_t mod_u64(uint128_t n, uint64_t d)
+{
+  uint64_t hi = (uint64_t) (n >> 64);
+  if (hi >= d)
+    hi %= d;
+  return mod_u64(hi, (uint64_t) n, d);
+}
+
+} // namespace
+
 #endif
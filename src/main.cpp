@@ -1,8 +1,10 @@
 ///
 /// @file   main.cpp
 /// @brief  Command-line program which uses the Pseudosquares Prime
-///         Sieve algorithm to generate primes ≤ 1.73 * 10^33.
-///         The algorithm has been parallelized using std::async.
+///         Sieve algorithm to generate primes ≤ 1.73 * 10^33
+///         (or < 2^158 using additional pseudosquares).
+///         The algorithm has been parallelized using a thread pool,
+///         see pseudosquares_prime_sieve_parallel().
 ///
 /// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
 ///
@@ -12,16 +14,21 @@
 
 #include "pseudosquares_prime_sieve.hpp"
 #include "CmdOptions.hpp"
+#include "host_profile.hpp"
+#include "perf_counters.hpp"
+#include "shard.hpp"
+#include "trace.hpp"
 
-#include <algorithm>
 #include <chrono>
-#include <cmath>
+#include <cstddef>
 #include <cstdlib>
-#include <future>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <stdint.h>
-#include <thread>
+#include <string>
 #include <vector>
 
 void help(int exit_code)
@@ -32,11 +39,53 @@ void help(int exit_code)
         "J. P. Sorenson's Pseudosquares Prime Sieve.\n"
         "\n"
         "Options:\n"
+        "      --affinity     Pin each thread to its own CPU core.\n"
         "  -d, --dist=DIST    Sieve the interval [START, START + DIST].\n"
+        "      --engine=NAME  auto: use libprimesieve for primes < 2^64 (default),\n"
+        "                     primesieve: requires STOP < 2^64,\n"
+        "                     pseudosquares: only use the Pseudosquares Prime Sieve.\n"
         "  -h, --help         Print this help menu.\n"
+        "      --max-memory=SIZE\n"
+        "                     Limit the memory usage of all threads to SIZE\n"
+        "                     (e.g. 512M, 4G), uses fewer threads, smaller\n"
+        "                     segments and fewer sieving primes if needed.\n"
+        "      --merge[=FILE] Merge the result records of --shard read from\n"
+        "                     FILE (default: stdin), checks that all shards\n"
+        "                     are present and cover the interval.\n"
+        "      --numa         Spread the threads across the NUMA nodes, the\n"
+        "                     buffers are allocated on each thread's node.\n"
+        "      --perf-counters\n"
+        "                     Count CPU cycles, instructions, cache misses and\n"
+        "                     branch mispredictions of the sieve, extract and\n"
+        "                     test phases using perf events (Linux only).\n"
+        "      --pipeline[=NUM]\n"
+        "                     Sieve and test the candidates on different\n"
+        "                     threads connected by a bounded queue, NUM\n"
+        "                     threads prefer sieving. Default: self-balancing.\n"
+        "      --physical-cores\n"
+        "                     Use one thread per physical CPU core by default,\n"
+        "                     instead of one thread per SMT sibling.\n"
         "  -p, --print        Print primes to the standard output.\n"
+        "      --pseudosquares=FILE\n"
+        "                     Load additional pseudosquares Lp from FILE, each\n"
+        "                     line contains: p Lp. Allows sieving > 10^33.\n"
+        "      --shard=i/N    Only sieve the i-th (0 <= i < N) of N shards of\n"
+        "                     [START, STOP] and print a result record.\n"
+        "      --sieving-primes=FILE\n"
+        "                     Memory map the sieving primes from FILE, the\n"
+        "                     file is created if it does not exist. Speeds\n"
+        "                     up the startup of short intervals > 10^20.\n"
         "  -t, --threads=NUM  Set the number of threads, NUM <= CPU cores.\n"
-        "                     Default setting: use all available CPU cores.\n"
+        "                     Default setting: use all CPU cores available to\n"
+        "                     this process (CPU affinity, cgroup CPU quota).\n"
+        "      --trace=FILE   Write a timeline of each thread's work (setup, sieve,\n"
+        "                     extract, test, waits, output) to FILE in the Chrome\n"
+        "                     trace format, view it using ui.perfetto.dev.\n"
+        "      --tune[=FILE]  Measure the fastest sieve size, threads and\n"
+        "                     modpow kernel on this host and save them to\n"
+        "                     FILE (default: ~/.pseudosquares_prime_sieve_profile\n"
+        "                     or $PSEUDOSQUARES_PROFILE). Later runs on the\n"
+        "                     same CPU model load the default profile.\n"
         "  -v, --version      Print version and license information.\n";
 
     std::cout << help_menu << std::endl;
@@ -55,12 +104,127 @@ void version()
 
 namespace {
 
-double get_min_thread_dist(uint128_t stop)
+/// Sieve the primes inside [start, stop] in parallel,
+/// T is either uint128_t or uint256_t.
+///
+template <typename T>
+uint64_t sieve_primes(const T& start, const T& stop, const CmdOptions& opts, ShardResult& shard)
 {
-    double min_thread_dist = 1e4;
-    double root5_stop = std::pow(stop, 1.0 / 5.0);
-    min_thread_dist = std::max(min_thread_dist, root5_stop);
-    return min_thread_dist;
+    // The digests of a shard require the primes
+    if (opts.shards > 0)
+    {
+        bool print_primes = opts.print_primes;
+        auto sink = [&](const T* primes, std::size_t size) {
+            if (print_primes)
+                PrintSink()(primes, size);
+            shard.add_digest(primes, size);
+        };
+
+        return pseudosquares_prime_sieve_parallel(start, stop, opts.threads, sink, !print_primes, opts.engine);
+    }
+
+    if (opts.print_primes)
+        return pseudosquares_prime_sieve_parallel(start, stop, opts.threads, PrintSink(), false, opts.engine);
+    else
+        return pseudosquares_prime_sieve_parallel(start, stop, opts.threads, nullptr, true, opts.engine);
+}
+
+/// Combine the result records of all shards
+void merge(const CmdOptions& opts)
+{
+    std::vector<ShardResult> shards;
+
+    if (opts.merge_file.empty())
+        shards = read_shards(std::cin);
+    else
+    {
+        std::ifstream file(opts.merge_file);
+        if (!file)
+            throw std::runtime_error("merge: failed to open " + opts.merge_file);
+        shards = read_shards(file);
+    }
+
+    ShardResult merged = merge_shards(shards);
+
+    std::cout << "Merged " << shards.size() << " shards of [" << merged.range_start << ", " << merged.range_stop << "]" << std::endl;
+    std::cout << "\nPrimes: " << merged.primes << std::endl;
+    std::cout << to_string(merged) << std::endl;
+}
+
+/// Measure the fastest tuning parameters of this host
+void tune(const CmdOptions& opts)
+{
+    std::string filename = opts.tune_file;
+
+    if (filename.empty())
+        filename = get_profile_path();
+    if (filename.empty())
+        throw std::runtime_error("tune: no home directory, use --tune=FILE");
+
+    HostProfile profile = tune_host_profile(true);
+    write_profile(filename, profile);
+    std::cout << "Host profile: " << filename << std::endl;
+}
+
+/// Performance counters of the sieve, extract and test
+/// phases of the Pseudosquares Prime Sieve (not of
+/// libprimesieve), summed over all threads.
+///
+void print_perf_counters(const std::string& error)
+{
+    if (!error.empty())
+    {
+        std::cout << "Perf counters: not available, " << error << std::endl;
+        return;
+    }
+
+    PerfCounts perf = get_perf_counts();
+    const char* phases[PERF_PHASES] = { "sieve", "extract", "test" };
+
+    std::cout << "\n" << std::left << std::setw(24) << "Perf counters" << std::right;
+    for (const char* phase : phases)
+        std::cout << std::setw(16) << phase;
+    std::cout << std::endl;
+
+    for (int i = 0; i < PERF_EVENTS; i++)
+    {
+        PerfEvent event = (PerfEvent) i;
+        std::string name = get_perf_event_name(event);
+        if (event == PERF_TASK_CLOCK)
+            name += " (ms)";
+
+        std::cout << std::left << std::setw(24) << name << std::right;
+
+        for (int phase = 0; phase < PERF_PHASES; phase++)
+        {
+            uint64_t count = perf.counts[phase][event];
+            std::cout << std::setw(16);
+
+            if (!perf.available[event])
+                std::cout << "n/a";
+            else if (event == PERF_TASK_CLOCK)
+                std::cout << std::setprecision(3) << count / 1e6;
+            else
+                std::cout << count;
+        }
+
+        std::cout << std::endl;
+
+        // Instructions per cycle
+        if (event == PERF_INSTRUCTIONS &&
+            perf.available[PERF_CYCLES] &&
+            perf.available[PERF_INSTRUCTIONS])
+        {
+            std::cout << std::left << std::setw(24) << "IPC" << std::right;
+            for (int phase = 0; phase < PERF_PHASES; phase++)
+            {
+                uint64_t cycles = perf.counts[phase][PERF_CYCLES];
+                double ipc = (cycles > 0) ? (double) perf.counts[phase][PERF_INSTRUCTIONS] / cycles : 0;
+                std::cout << std::setw(16) << std::setprecision(2) << ipc;
+            }
+            std::cout << std::endl;
+        }
+    }
 }
 
 } // namespace
@@ -71,11 +235,23 @@ int main(int argc, char** argv)
     {
         CmdOptions opts = parseOptions(argc, argv);
 
+        if (opts.merge)
+        {
+            merge(opts);
+            return 0;
+        }
+
+        if (opts.tune)
+        {
+            tune(opts);
+            return 0;
+        }
+
         if (opts.numbers.empty())
             help(1);
 
-        uint128_t start = 0;
-        uint128_t stop = 0;
+        uint256_t start = 0;
+        uint256_t stop = 0;
 
         if (opts.numbers.size() == 1)
         {
@@ -94,54 +270,60 @@ int main(int argc, char** argv)
                 std::cout << "Sieving primes inside [" << start_str << ", " << stop_str << "]" << std::endl;
         }
 
-        auto t1 = std::chrono::system_clock::now();
-        uint64_t count = 0;
+        if (!opts.pseudosquares_file.empty())
+            load_pseudosquares(opts.pseudosquares_file);
+        if (!opts.sieving_primes_file.empty())
+            load_sieving_primes(opts.sieving_primes_file);
+        if (opts.pipeline != PIPELINE_OFF)
+            set_pipeline(opts.pipeline);
+        if (opts.max_memory > 0)
+            set_max_memory(opts.max_memory);
+        if (opts.affinity != AFFINITY_NONE)
+            set_affinity(opts.affinity);
+        if (opts.physical_cores)
+            set_physical_cores(true);
 
-        if (start <= stop)
-        {
-            int threads = opts.threads;
-            int max_threads = std::thread::hardware_concurrency();
-            max_threads = std::max(1, max_threads);
+        // Performance counters are optional
+        std::string perf_error;
+        if (opts.perf_counters)
+            enable_perf_counters(perf_error);
+        if (!opts.trace_file.empty())
+            enable_trace();
 
-            if (threads > 0)
-                threads = std::min(threads, max_threads);
-            else
-            {
-                double min_thread_dist = get_min_thread_dist(stop);
-                double t = (stop - start) / min_thread_dist;
-                t = std::min(t, (double) max_threads);
-                threads = (int) std::max(1.0, t);
-            }
+        // Created by a previous run with --tune. The profile is
+        // loaded implicitly, hence a corrupt profile must not
+        // prevent sieving, we use the default heuristics instead.
+        std::string profile = get_profile_path();
 
-            if (opts.print_primes)
-                threads = 1;
+        try {
+            if (load_host_profile(profile) && !opts.print_primes)
+                std::cout << "Host profile: " << profile << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "pseudosquares_prime_sieve: warning: ignoring " << profile << ": " << e.what() << std::endl;
+        }
 
-            uint128_t thread_dist = (stop - start) / threads + 1;
+        ShardResult shard;
 
+        if (opts.shards > 0)
+        {
+            shard = get_shard(start, stop, opts.shard_index, opts.shards);
+            start = shard.start;
+            stop = shard.stop;
             if (!opts.print_primes)
-            {
-                std::cout << "Thread dist: " << thread_dist << std::endl;
-                std::cout << "Threads: " << threads << std::endl;
-                std::cout << std::endl;
-            }
-
-            std::vector<std::future<uint64_t>> futures;
-            futures.reserve(threads);
+                std::cout << "Shard " << shard.index << "/" << shard.shards << ": [" << start << ", " << stop << "]" << std::endl;
+        }
 
-            for (int i = 0; i < threads; i++)
-            {
-                uint128_t low = start + i * thread_dist;
-                uint128_t high = low + thread_dist - 1;
-                high = std::min(high, stop);
-                bool verbose = (i == 0) && !opts.print_primes;
-
-                futures.emplace_back(std::async(std::launch::async, [=]() {
-                    return pseudosquares_prime_sieve(low, high, opts.print_primes, verbose);
-                }));
-            }
+        auto t1 = std::chrono::system_clock::now();
+        uint64_t count = 0;
 
-            for (auto& fut : futures)
-                count += fut.get();
+        // Use the faster 128-bit implementation if possible
+        if (start <= stop)
+        {
+            if (stop <= std::numeric_limits<uint128_t>::max() / 4)
+                count = sieve_primes((uint128_t) start, (uint128_t) stop, opts, shard);
+            else
+                count = sieve_primes(start, stop, opts, shard);
         }
 
         auto t2 = std::chrono::system_clock::now();
@@ -149,11 +331,28 @@ int main(int argc, char** argv)
 
         std::cout << "\nPrimes: " << count << std::endl;
         std::cout << "Seconds: " << std::fixed << std::setprecision(3) << seconds.count() << std::endl;
+
+        if (opts.perf_counters)
+            print_perf_counters(perf_error);
+
+        if (!opts.trace_file.empty())
+        {
+            write_trace(opts.trace_file);
+            std::cout << "Trace: " << opts.trace_file << std::endl;
+        }
+
+        if (opts.shards > 0)
+        {
+            shard.primes = count;
+            shard.seconds = seconds.count();
+            std::cout << to_string(shard) << std::endl;
+        }
     }
     catch (const std::exception& e)
     {
         std::cerr << "pseudosquares_prime_sieve: " << e.what() << std::endl;
         std::cerr << "Try 'pseudosquares_prime_sieve --help' for more information." << std::endl;
+        return 1;
     }
 
     return 0;
@@ -3,6 +3,10 @@
 /// @brief  Fast modular exponentiation of 64-bit and 128-bit
 ///         integers using the hurchalla/modular_arithmetic library:
 ///         https://github.com/hurchalla/modular_arithmetic
+///         Moduli < 2^96 use our Montgomery96 class and moduli
+///         > 2^126 use our MontgomeryWide class. On x86 CPUs
+///         with AVX512 IFMA modpow_batch() computes 8 modular
+///         exponentiations at once using SIMD instructions.
 ///
 /// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
 ///
@@ -15,12 +19,21 @@
 
 #include "int128_t.hpp"
 #include "macros.hpp"
+#include "Montgomery96.hpp"
+#include "MontgomeryWide.hpp"
+#include "uint256_t.hpp"
 
 #include <hurchalla/modular_arithmetic/modular_pow.h>
 #include <hurchalla/montgomery_arithmetic/MontgomeryForm.h>
 #include <hurchalla/montgomery_arithmetic/montgomery_form_aliases.h>
 #include <hurchalla/montgomery_arithmetic/detail/platform_specific/montgomery_two_pow.h>
 
+#if defined(ENABLE_MULTIARCH_AVX512_IFMA)
+  #include "cpu_supports_avx512_ifma.hpp"
+  #include "modpow_x86_avx512_ifma.hpp"
+#endif
+
+#include <cstddef>
 #include <stdint.h>
 
 namespace {
@@ -54,6 +67,11 @@ uint128_t modpow(uint128_t exponent, uint128_t modulus)
         uint64_t res = mf.convertOut(res_montval);
         return res;
     }
+    else if (modulus <= Montgomery96::max_modulus())
+    {
+        Montgomery96 mf(modulus);
+        return mf.convert_out(mf.two_pow(exponent));
+    }
     else
     {
         ASSERT(modulus <= std::numeric_limits<uint128_t>::max() / 4);
@@ -91,10 +109,15 @@ uint128_t modpow(uint64_t base, uint128_t exponent, uint128_t modulus)
         uint64_t res = mf.convertOut(res_montval);
         return res;
     }
+    else if (modulus <= Montgomery96::max_modulus())
+    {
+        Montgomery96 mf(modulus);
+        return mf.convert_out(mf.pow(mf.convert_in(base), exponent));
+    }
     else
     {
         // Our Pseudosquares Prime Sieve implementation
-        // is limited by n (modulus) <= 1.73 * 10^33
+        // is limited by n (modulus) < 2^126
         ASSERT(modulus <= std::numeric_limits<uint128_t>::max() / 4);
         hurchalla::MontgomeryQuarter<uint128_t> mf(modulus);
         auto base_montval = mf.convertIn(base);
@@ -104,6 +127,90 @@ uint128_t modpow(uint64_t base, uint128_t exponent, uint128_t modulus)
     }
 }
 
+/// base^e mod m using N-word Montgomery arithmetic,
+/// base = 2 uses the faster two_pow() algorithm.
+///
+template <std::size_t N>
+uint256_t montgomery_wide_pow(uint64_t base,
+                              const uint256_t& exponent,
+                              const uint256_t& modulus)
+{
+    using T = WideUint<N>;
+    MontgomeryWide<N> mf{T(modulus)};
+    T e(exponent);
+    T res;
+
+    if (base == 2)
+        res = mf.two_pow(e);
+    else
+        res = mf.pow(mf.convert_in(base), e);
+
+    return uint256_t(mf.convert_out(res));
+}
+
+uint256_t modpow(uint64_t base, const uint256_t& exponent, const uint256_t& modulus)
+{
+    // Montgomery modular exponentiation
+    // requires that the modulus is odd.
+    ASSERT(modulus.word(0) % 2 == 1);
+    ASSERT(exponent < modulus);
+
+    // Use the fastest Montgomery implementation that
+    // supports the modulus (<= 2^(64 * N) / 4).
+    if (modulus.fits_words(2) && modulus.bit_length() <= 126)
+    {
+        uint128_t e = (uint128_t) exponent;
+        uint128_t m = (uint128_t) modulus;
+        return (base == 2) ? modpow<2>(e, m) : modpow(base, e, m);
+    }
+    else if (modulus.fits_words(3) && modulus.bit_length() <= 190)
+        return montgomery_wide_pow<3>(base, exponent, modulus);
+    else
+    {
+        ASSERT(modulus.bit_length() <= 254);
+        return montgomery_wide_pow<4>(base, exponent, modulus);
+    }
+}
+
+/// modpow<2>(e, m) = 2^e mod m
+template <int two>
+uint256_t modpow(const uint256_t& exponent, const uint256_t& modulus)
+{
+    static_assert(two == 2, "modpow: two != 2");
+    return modpow(two, exponent, modulus);
+}
+
+/// res[i] = base^exponent[i] mod modulus[i] for i < count.
+/// The modular exponentiations are independent of each
+/// other, hence we can compute them in SIMD lanes.
+/// simd = false forces the portable kernel.
+///
+template <typename T>
+void modpow_batch(uint64_t base,
+                  const T* exponent,
+                  const T* modulus,
+                  T* res,
+                  std::size_t count,
+                  bool simd = true)
+{
+    std::size_t i = 0;
+
+#if defined(ENABLE_MULTIARCH_AVX512_IFMA)
+    if (simd && cpu_supports_avx512_ifma)
+        i = modpow_x86_avx512_ifma(base, exponent, modulus, res, count);
+#else
+    (void) simd;
+#endif
+
+    for (; i < count; i++)
+    {
+        if (base == 2)
+            res[i] = modpow<2>(exponent[i], modulus[i]);
+        else
+            res[i] = modpow(base, exponent[i], modulus[i]);
+    }
+}
+
 } // namespace
 
 #endif
@@ -0,0 +1,369 @@
+///
+/// @file   modpow_x86_avx512_ifma.hpp
+/// @brief  Modular exponentiation of 8 different moduli at once
+///         using the AVX512 IFMA instruction set. The numbers are
+///         split into L limbs of 52 bits and multiplied using the
+///         vpmadd52luq and vpmadd52huq instructions which compute
+///         the lower and upper 52 bits of 52-bit x 52-bit products
+///         in 8 SIMD lanes. Montgomery multiplication uses the
+///         CIOS algorithm, same as MontgomeryWide.hpp.
+///
+///         The candidates of a sieving segment are independent
+///         and have (nearly) the same number of bits, hence the
+///         Pseudosquares Prime Test of 8 candidates can be
+///         computed in parallel, see modpow_batch().
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef MODPOW_X86_AVX512_IFMA_HPP
+#define MODPOW_X86_AVX512_IFMA_HPP
+
+#include "int128_t.hpp"
+#include "macros.hpp"
+#include "uint256_t.hpp"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+
+#define IFMA_TARGET __attribute__ ((target ("avx512f,avx512ifma")))
+
+namespace {
+
+const uint64_t limb_mask = (uint64_t(1) << 52) - 1;
+
+/// Number of bits of x
+template <std::size_t N>
+ALWAYS_INLINE std::size_t bit_length(const WideUint<N>& x)
+{
+    return x.bit_length();
+}
+
+ALWAYS_INLINE std::size_t bit_length(uint128_t x)
+{
+    uint64_t hi = (uint64_t) (x >> 64);
+    uint64_t lo = (uint64_t) x;
+    if (hi)
+        return 128 - __builtin_clzll(hi);
+    if (lo)
+        return 64 - __builtin_clzll(lo);
+    return 0;
+}
+
+/// 8 SIMD lanes of numbers with L limbs of 52 bits
+template <int L>
+struct VecIFMA
+{
+    __m512i limb[L];
+};
+
+/// Montgomery arithmetic with R = 2^(52 * L) for 8 odd
+/// moduli < R / 4. Values are in [0, 2n) (lazy reduction),
+/// this way Montgomery multiplication does not require a
+/// final subtraction.
+///
+template <int L>
+class MontgomeryIFMA
+{
+public:
+    using Vec = VecIFMA<L>;
+
+    IFMA_TARGET MontgomeryIFMA(const Vec& n, const Vec& n2, __m512i ninv)
+        : n_(n),
+          n2_(n2),
+          ninv_(ninv)
+    { }
+
+    /// x * y * R^-1 mod n, x, y < 2n
+    IFMA_TARGET ALWAYS_INLINE Vec multiply(const Vec& x, const Vec& y) const
+    {
+        const __m512i mask = _mm512_set1_epi64(limb_mask);
+        const __m512i zero = _mm512_setzero_si512();
+        __m512i t[L + 1];
+
+        for (int j = 0; j <= L; j++)
+            t[j] = zero;
+
+        for (int i = 0; i < L; i++)
+        {
+            // t += x * y[i]. The limbs of t are not normalized,
+            // they have 12 bits of headroom for carries.
+            for (int j = 0; j < L; j++)
+            {
+                t[j] = _mm512_madd52lo_epu64(t[j], x.limb[j], y.limb[i]);
+                t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], x.limb[j], y.limb[i]);
+            }
+
+            // t = (t + m * n) / 2^52
+            __m512i m = _mm512_madd52lo_epu64(zero, t[0], ninv_);
+            m = _mm512_and_si512(m, mask);
+
+            for (int j = 0; j < L; j++)
+            {
+                t[j] = _mm512_madd52lo_epu64(t[j], n_.limb[j], m);
+                t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], n_.limb[j], m);
+            }
+
+            // The lower 52 bits of t[0] are now 0
+            t[1] = _mm512_add_epi64(t[1], _mm512_srli_epi64(t[0], 52));
+            for (int j = 0; j < L; j++)
+                t[j] = t[j + 1];
+            t[L] = zero;
+        }
+
+        Vec res;
+        for (int j = 0; j < L - 1; j++)
+        {
+            t[j + 1] = _mm512_add_epi64(t[j + 1], _mm512_srli_epi64(t[j], 52));
+            res.limb[j] = _mm512_and_si512(t[j], mask);
+        }
+
+        // Since n < R / 4 the result is < 2n and
+        // the upper limb has < 52 bits.
+        res.limb[L - 1] = t[L - 1];
+        return res;
+    }
+
+    IFMA_TARGET ALWAYS_INLINE Vec square(const Vec& x) const
+    {
+        return multiply(x, x);
+    }
+
+    /// (x + x) mod 2n, x < 2n
+    IFMA_TARGET ALWAYS_INLINE Vec twice(const Vec& x) const
+    {
+        const __m512i mask = _mm512_set1_epi64(limb_mask);
+        __m512i carry = _mm512_setzero_si512();
+        __m512i borrow = _mm512_setzero_si512();
+        Vec sum, diff;
+
+        for (int j = 0; j < L; j++)
+        {
+            __m512i s = _mm512_add_epi64(_mm512_slli_epi64(x.limb[j], 1), carry);
+            carry = _mm512_srli_epi64(s, 52);
+            sum.limb[j] = _mm512_and_si512(s, mask);
+
+            // diff = sum - 2n, the borrow is -1 or 0
+            __m512i d = _mm512_add_epi64(_mm512_sub_epi64(sum.limb[j], n2_.limb[j]), borrow);
+            borrow = _mm512_srai_epi64(d, 52);
+            diff.limb[j] = _mm512_and_si512(d, mask);
+        }
+
+        // Select diff in all lanes with sum >= 2n
+        __mmask8 ge = _mm512_cmpeq_epi64_mask(borrow, _mm512_setzero_si512());
+        return select(ge, sum, diff);
+    }
+
+    /// Select y in the lanes whose bit is set in mask,
+    /// otherwise select x.
+    ///
+    IFMA_TARGET ALWAYS_INLINE static Vec select(__mmask8 mask, const Vec& x, const Vec& y)
+    {
+        Vec res;
+        for (int j = 0; j < L; j++)
+            res.limb[j] = _mm512_mask_blend_epi64(mask, x.limb[j], y.limb[j]);
+        return res;
+    }
+
+private:
+    Vec n_;
+    Vec n2_;
+    __m512i ninv_;
+};
+
+/// Store the 52-bit limbs of n in lane i
+template <int L, typename T>
+void set_lane(uint64_t (&limbs)[L][8], int i, const T& n)
+{
+    for (int j = 0; j < L; j++)
+        limbs[j][i] = (uint64_t) (n >> (52 * j)) & limb_mask;
+}
+
+template <int L>
+IFMA_TARGET ALWAYS_INLINE VecIFMA<L> load(const uint64_t (&limbs)[L][8])
+{
+    VecIFMA<L> x;
+    for (int j = 0; j < L; j++)
+        x.limb[j] = _mm512_load_si512((const __m512i*) limbs[j]);
+    return x;
+}
+
+/// res[i] = base^exponent[i] mod modulus[i] for i < 8.
+/// All moduli must be odd and < 2^(52 * L) / 4.
+///
+template <int L, typename T>
+IFMA_TARGET NOINLINE
+void modpow_x86_avx512_ifma(uint64_t base,
+                            const T* exponent,
+                            const T* modulus,
+                            T* res)
+{
+    using Vec = VecIFMA<L>;
+    constexpr int max_words = (sizeof(T) + 7) / 8;
+
+    alignas(64) uint64_t n[L][8];
+    alignas(64) uint64_t n2[L][8];
+    alignas(64) uint64_t one[L][8];
+    alignas(64) uint64_t base_r[L][8];
+    alignas(64) uint64_t ninv[8];
+    alignas(64) uint64_t e_words[max_words][8];
+    std::size_t e_bits = 0;
+
+    // Scalar precomputation for each lane
+    for (int i = 0; i < 8; i++)
+    {
+        const T& m = modulus[i];
+        ASSERT(bit_length(m) <= 52 * L - 2);
+
+        // Newton's iteration doubles the number of
+        // correct bits of n^-1 mod 2^64 each step.
+        uint64_t m0 = (uint64_t) m;
+        uint64_t inv = m0;
+        for (int k = 0; k < 5; k++)
+            inv *= 2 - m0 * inv;
+        ninv[i] = (0 - inv) & limb_mask;
+
+        // R mod n = 2^(52 * L) mod n
+        T r = 1;
+        for (int k = 0; k < 52 * L; k++)
+        {
+            r += r;
+            if (r >= m)
+                r -= m;
+        }
+
+        // base * R mod n
+        T b = 0;
+        T pow2 = r;
+        for (uint64_t k = base; k > 0; k >>= 1)
+        {
+            if (k & 1)
+            {
+                b += pow2;
+                if (b >= m)
+                    b -= m;
+            }
+            pow2 += pow2;
+            if (pow2 >= m)
+                pow2 -= m;
+        }
+
+        set_lane(n, i, m);
+        set_lane(n2, i, T(m + m));
+        set_lane(one, i, r);
+        set_lane(base_r, i, b);
+
+        for (int w = 0; w < max_words; w++)
+            e_words[w][i] = (uint64_t) (exponent[i] >> (64 * w));
+        e_bits = std::max(e_bits, bit_length(exponent[i]));
+    }
+
+    MontgomeryIFMA<L> mf(load(n), load(n2), _mm512_load_si512((const __m512i*) ninv));
+    Vec base_mont = load(base_r);
+    Vec y = load(one);
+
+    // Left-to-right binary exponentiation, each lane
+    // has its own exponent. We always square and then
+    // multiply only in the lanes whose exponent bit is
+    // set. Leading zero bits of shorter exponents are
+    // harmless since one^2 = one.
+    for (std::size_t k = e_bits; k-- > 0;)
+    {
+        y = mf.square(y);
+        __m512i e = _mm512_load_si512((const __m512i*) e_words[k / 64]);
+        __m512i bit = _mm512_set1_epi64((long long) (uint64_t(1) << (k % 64)));
+        __mmask8 mask = _mm512_test_epi64_mask(e, bit);
+
+        if (mask)
+        {
+            // Multiplying by 2 is a modular addition
+            if (base == 2)
+                y = mf.select(mask, y, mf.twice(y));
+            else
+                y = mf.select(mask, y, mf.multiply(y, base_mont));
+        }
+    }
+
+    // Convert out of Montgomery form, multiplying
+    // by 1 yields a result in [0, n].
+    Vec unit;
+    unit.limb[0] = _mm512_set1_epi64(1);
+    for (int j = 1; j < L; j++)
+        unit.limb[j] = _mm512_setzero_si512();
+    y = mf.multiply(y, unit);
+
+    alignas(64) uint64_t limbs[L][8];
+    for (int j = 0; j < L; j++)
+        _mm512_store_si512((__m512i*) limbs[j], y.limb[j]);
+
+    for (int i = 0; i < 8; i++)
+    {
+        T r = 0;
+        for (int j = L - 1; j >= 0; j--)
+            r = (r << 52) | T(limbs[j][i]);
+        if (r >= modulus[i])
+            r -= modulus[i];
+        res[i] = r;
+    }
+}
+
+/// res[i] = base^exponent[i] mod modulus[i] for i < count.
+/// The moduli are processed in chunks of 8, the last chunk
+/// is padded. Returns the number of moduli processed, this
+/// is less than count if a modulus is too large for the
+/// supported number of limbs.
+///
+template <typename T>
+std::size_t modpow_x86_avx512_ifma(uint64_t base,
+                                   const T* exponent,
+                                   const T* modulus,
+                                   T* res,
+                                   std::size_t count)
+{
+    std::size_t i = 0;
+
+    for (; i < count; i += 8)
+    {
+        T e[8], m[8], r[8];
+        std::size_t lanes = std::min(count - i, (std::size_t) 8);
+        std::size_t bits = 0;
+
+        for (std::size_t j = 0; j < 8; j++)
+        {
+            e[j] = exponent[i + std::min(j, lanes - 1)];
+            m[j] = modulus[i + std::min(j, lanes - 1)];
+            bits = std::max(bits, bit_length(m[j]));
+        }
+
+        // Use the smallest number of limbs L
+        // such that 4 * modulus < 2^(52 * L).
+        if (bits <= 50)
+            modpow_x86_avx512_ifma<1>(base, e, m, r);
+        else if (bits <= 102)
+            modpow_x86_avx512_ifma<2>(base, e, m, r);
+        else if (bits <= 154)
+            modpow_x86_avx512_ifma<3>(base, e, m, r);
+        else if constexpr (sizeof(T) > sizeof(uint128_t))
+        {
+            if (bits <= 206)
+                modpow_x86_avx512_ifma<4>(base, e, m, r);
+            else if (bits <= 258)
+                modpow_x86_avx512_ifma<5>(base, e, m, r);
+            else
+                return i;
+        }
+
+        std::copy(r, r + lanes, res + i);
+    }
+
+    return count;
+}
+
+} // namespace
+
+#endif
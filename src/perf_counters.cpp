@@ -0,0 +1,225 @@
+///
+/// @file  perf_counters.cpp
+/// @brief Each thread opens its own perf_event group that counts
+///        the events of that thread only. The counters are read
+///        at the start and at the end of each phase and the
+///        differences are added to the global totals. The task
+///        clock is the group leader as it is also available
+///        inside virtual machines without a PMU, hardware
+///        events that cannot be opened are not reported.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#include "perf_counters.hpp"
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#if defined(__linux__)
+  #include <linux/perf_event.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+  #include <cerrno>
+  #include <cstring>
+#endif
+
+namespace {
+
+const char* event_names[PERF_EVENTS] =
+{
+    "task-clock",
+    "cycles",
+    "instructions",
+    "L1-dcache-load-misses",
+    "LLC-load-misses",
+    "branch-misses"
+};
+
+std::atomic<bool> enabled(false);
+std::atomic<uint64_t> totals[PERF_PHASES][PERF_EVENTS];
+bool available[PERF_EVENTS];
+
+#if defined(__linux__)
+
+struct EventConfig
+{
+    uint32_t type;
+    uint64_t config;
+};
+
+const uint64_t cache_read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+const EventConfig events[PERF_EVENTS] =
+{
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cache_read_miss },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | cache_read_miss },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+/// Count the event in user space for the calling
+/// thread on any CPU, returns -1 on failure.
+///
+int open_event(const EventConfig& event, int group_fd)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+class PerfGroup
+{
+public:
+    PerfGroup()
+    {
+        for (int& fd : fds_)
+            fd = -1;
+
+        fds_[0] = open_event(events[0], -1);
+        if (fds_[0] < 0)
+            return;
+
+        for (int i = 1; i < PERF_EVENTS; i++)
+            if (available[i])
+                fds_[i] = open_event(events[i], fds_[0]);
+    }
+
+    ~PerfGroup()
+    {
+        for (int fd : fds_)
+            if (fd >= 0)
+                close(fd);
+    }
+
+    /// The values of a group are read in the order
+    /// in which the events have been opened.
+    ///
+    void read(uint64_t* values) const
+    {
+        struct
+        {
+            uint64_t nr;
+            uint64_t values[PERF_EVENTS];
+        } group;
+
+        for (int i = 0; i < PERF_EVENTS; i++)
+            values[i] = 0;
+
+        if (fds_[0] < 0 ||
+            ::read(fds_[0], &group, sizeof(group)) <= 0)
+            return;
+
+        uint64_t j = 0;
+
+        for (int i = 0; i < PERF_EVENTS && j < group.nr; i++)
+            if (fds_[i] >= 0)
+                values[i] = group.values[j++];
+    }
+
+private:
+    int fds_[PERF_EVENTS];
+};
+
+PerfGroup& get_perf_group()
+{
+    thread_local PerfGroup group;
+    return group;
+}
+
+#endif
+
+} // namespace
+
+bool enable_perf_counters(std::string& error)
+{
+#if defined(__linux__)
+    int leader = open_event(events[0], -1);
+
+    if (leader < 0)
+    {
+        error = std::string("perf_event_open: ") + std::strerror(errno);
+        return false;
+    }
+
+    available[0] = true;
+
+    for (int i = 1; i < PERF_EVENTS; i++)
+    {
+        int fd = open_event(events[i], leader);
+        available[i] = (fd >= 0);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    close(leader);
+    enabled = true;
+    return true;
+#else
+    error = "requires Linux";
+    return false;
+#endif
+}
+
+bool perf_counters_enabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+const char* get_perf_event_name(PerfEvent event)
+{
+    return event_names[event];
+}
+
+PerfCounts get_perf_counts()
+{
+    PerfCounts counts;
+
+    for (int j = 0; j < PERF_EVENTS; j++)
+        counts.available[j] = enabled && available[j];
+
+    for (int i = 0; i < PERF_PHASES; i++)
+        for (int j = 0; j < PERF_EVENTS; j++)
+            counts.counts[i][j] = totals[i][j].load(std::memory_order_relaxed);
+
+    return counts;
+}
+
+void perf_begin(uint64_t* values)
+{
+#if defined(__linux__)
+    get_perf_group().read(values);
+#else
+    for (int i = 0; i < PERF_EVENTS; i++)
+        values[i] = 0;
+#endif
+}
+
+void perf_end(PerfPhase phase, const uint64_t* values)
+{
+#if defined(__linux__)
+    uint64_t now[PERF_EVENTS];
+    get_perf_group().read(now);
+
+    for (int i = 0; i < PERF_EVENTS; i++)
+        if (now[i] > values[i])
+            totals[phase][i].fetch_add(now[i] - values[i], std::memory_order_relaxed);
+#else
+    (void) phase;
+    (void) values;
+#endif
+}
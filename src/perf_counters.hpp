@@ -0,0 +1,97 @@
+///
+/// @file  perf_counters.hpp
+/// @brief Hardware performance counters of the sieve, extract
+///        and test phases of each segment, see --perf-counters.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <stdint.h>
+#include <string>
+
+enum PerfPhase
+{
+    // Cross off the multiples of the sieving primes
+    PERF_SIEVE,
+    // Count the primes or extract the candidates
+    PERF_EXTRACT,
+    // Pseudosquares Prime Test of the candidates
+    PERF_TEST,
+    PERF_PHASES
+};
+
+enum PerfEvent
+{
+    PERF_TASK_CLOCK,
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENTS
+};
+
+struct PerfCounts
+{
+    // Events that are not supported by the CPU
+    // (or the hypervisor) are not available.
+    bool available[PERF_EVENTS] = {};
+    uint64_t counts[PERF_PHASES][PERF_EVENTS] = {};
+};
+
+/// Count the events of all threads that sieve from now on.
+/// Returns false (and the reason in error) if performance
+/// events are not supported or not permitted, e.g. due
+/// to /proc/sys/kernel/perf_event_paranoid. Linux only.
+///
+bool enable_perf_counters(std::string& error);
+
+/// Sum of the counts of all threads
+PerfCounts get_perf_counts();
+
+const char* get_perf_event_name(PerfEvent event);
+
+void perf_begin(uint64_t* values);
+void perf_end(PerfPhase phase, const uint64_t* values);
+bool perf_counters_enabled();
+
+namespace {
+
+/// Adds the events of the current thread during
+/// the lifetime of PerfScope to the phase.
+///
+class PerfScope
+{
+public:
+    PerfScope(PerfPhase phase)
+        : phase_(phase),
+          enabled_(perf_counters_enabled())
+    {
+        if (enabled_)
+            perf_begin(values_);
+    }
+
+    ~PerfScope()
+    {
+        if (enabled_)
+            perf_end(phase_, values_);
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+    uint64_t values_[PERF_EVENTS];
+    PerfPhase phase_;
+    bool enabled_;
+};
+
+} // namespace
+
+#endif
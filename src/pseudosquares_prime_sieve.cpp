@@ -14,19 +14,42 @@
 ///
 
 #include "pseudosquares_prime_sieve.hpp"
+#include "arena.hpp"
+#include "cpu_cache_size.hpp"
+#include "cpu_topology.hpp"
 #include "int128_t.hpp"
 #include "modpow.hpp"
+#include "perf_counters.hpp"
 #include "Sieve.hpp"
+#include "sieving_primes_cache.hpp"
+#include "ThreadPool.hpp"
+#include "trace.hpp"
 #include "Vector.hpp"
 
 #include <primesieve.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iomanip>
 #include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
 #include <stdint.h>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace {
 
@@ -90,7 +113,7 @@ struct Pseudosquare
 };
 
 // List of known pseudosquares <= 4.2 * 10^24
-const Array<Pseudosquare, 74> pseudosquares =
+const Array<Pseudosquare, 74> known_pseudosquares =
 {{
       { 2, to_uint128("17") },
       { 3, to_uint128("73") },
@@ -168,282 +191,2486 @@ const Array<Pseudosquare, 74> pseudosquares =
     { 373, to_uint128("4235025223080597503519329") }
 }};
 
-struct SievingPrime
+Vector<Pseudosquare> get_known_pseudosquares()
 {
-    uint32_t prime;
-    int32_t i;
+    Vector<Pseudosquare> pss;
+    pss.insert(pss.end(), known_pseudosquares.begin(), known_pseudosquares.end());
+    return pss;
+}
+
+/// The pseudosquares used by the sieve. This list initially
+/// contains the known pseudosquares from above, it can be
+/// extended at runtime using load_pseudosquares().
+///
+Vector<Pseudosquare> pseudosquares = get_known_pseudosquares();
+
+/// Integer square root for WideUint
+template <typename T>
+T isqrt(const T& n)
+{
+    if (n == 0)
+        return 0;
 
-    SievingPrime(uint64_t p, int64_t index)
+    // Newton's iteration starting with an upper bound
+    // of the square root, the iterates then decrease
+    // monotonically until they reach the square root.
+    T x = T(1) << ((n.bit_length() + 1) / 2);
+
+    while (true)
     {
-        set_prime(p);
-        set_index(index);
+        T y = (x + n / x) / 2;
+        if (y >= x)
+            return x;
+        x = y;
     }
+}
+
+/// Integer square root
+template <>
+uint128_t isqrt(const uint128_t& n)
+{
+    if (n == 0)
+        return 0;
+
+    // The double precision estimate has a rounding error
+    // of up to 2^11 for n near 2^126, one Newton iteration
+    // reduces the error to +/- 1.
+    uint128_t r = (uint128_t) std::sqrt((double) n);
+    r = std::max(r, (uint128_t) 1);
+    r = (r + n / r) / 2;
+
+    while (r * r > n)
+        r--;
+    while ((r + 1) * (r + 1) <= n)
+        r++;
+
+    return r;
+}
+
+/// Returns true if r^k <= n
+template <typename T>
+bool ipow_less_equal(const T& r, int k, const T& n)
+{
+    T x = 1;
 
-    void set_prime(uint64_t p)
+    for (int i = 0; i < k; i++)
     {
-        ASSERT(p <= std::numeric_limits<decltype(prime)>::max());
-        prime = (decltype(prime)) p;
+        if (x > n / r)
+            return false;
+        x *= r;
     }
 
-    void set_index(int64_t index)
+    return true;
+}
+
+/// Integer k-th root for WideUint and k >= 3
+template <typename T>
+T iroot(const T& n, int k)
+{
+    ASSERT(k >= 3);
+    ASSERT(n > 0);
+
+    // Newton's iteration starting with an upper
+    // bound of the k-th root, same as isqrt().
+    T x = T(1) << ((n.bit_length() + k - 1) / k);
+
+    while (true)
     {
-        ASSERT(index <= std::numeric_limits<decltype(i)>::max());
-        i = (decltype(i)) index;
+        T xk = 1;
+        for (int i = 0; i < k - 1; i++)
+            xk *= x;
+        T y = (x * (k - 1) + n / xk) / k;
+        if (y >= x)
+            return x;
+        x = y;
     }
-};
+}
 
-// Generate sieving primes <= n
-Vector<SievingPrime> get_sieving_primes(uint64_t n)
+/// Integer k-th root for k >= 3, the root is < 2^43
+/// and hence the double precision estimate is at most
+/// off by 1.
+///
+template <>
+uint128_t iroot(const uint128_t& n, int k)
 {
-    // We sieve using all sieving primes <= s (n).
-    // Hence, s is the maximum sieving prime.
-    // We store the sieving prime in the uint32_t
-    // SievingPrime::prime variable.
-    if (n > std::numeric_limits<uint32_t>::max())
-        throw std::runtime_error("get_sieving_primes: n must be <= 2^32");
+    ASSERT(k >= 3);
+    uint128_t r = (uint128_t) std::pow((double) n, 1.0 / k);
+
+    while (r > 0 && !ipow_less_equal(r, k, n))
+        r--;
+    while (ipow_less_equal<uint128_t>(r + 1, k, n))
+        r++;
 
-    // We sieve using all sieving primes <= s (n).
-    // Hence, s is the maximum sieving prime. For each
-    // sieving prime we store its sieve array index
-    // in the int32_t SievingPrime::i variable. Since
-    // we use i += prime * 2; the maximum sieving
-    // prime must be <= max(int32_t) / 2.
-    if (n > std::numeric_limits<int32_t>::max() / 2)
-        throw std::runtime_error("get_sieving_primes: n must be <= 2^30");
+    return r;
+}
 
-    // pi(x) <= x / (log(x) - 1.1) + 5, for x >= 4.
-    // Pierre Dusart, https://arxiv.org/abs/1002.0442 eq. 6.6.
-    double x = (double) n;
-    x = std::max(100.0, x);
-    double pix = x / (std::log(x) - 1.1) + 5;
+/// Sorenson's algorithm requires removing perfect powers
+/// after sieving and running the Pseudosquares Prime Test.
+/// The numbers n passed to this function have no prime
+/// factors <= s, hence n = m^k implies m > s and k <
+/// log(n) / log(s). find_tuning() tries s >= 2^10, for n
+/// near 2^158 and s = 2^10 these are the prime exponents
+/// k < 16.
+///
+template <typename T>
+bool is_perfect_power(const T& n, uint64_t s)
+{
+    ASSERT(s >= 2);
+    double max_k = std::log((double) n) / std::log((double) s);
 
-    std::size_t size = (std::size_t) pix;
-    Vector<SievingPrime> sieving_primes;
-    sieving_primes.reserve(size);
-    primesieve::iterator it(3, n);
-    uint64_t prime;
+    for (int i = 0; primes[i] <= max_k; i++)
+    {
+        int k = primes[i];
 
-    while ((prime = it.next_prime()) <= n)
-        sieving_primes.emplace_back(prime, -1);
+        if (k == 2)
+        {
+            T r = isqrt(n);
+            if (r * r == n)
+                return true;
+        }
+        else
+        {
+            T r = iroot(n, k);
+            if (ipow_less_equal(r, k, n) &&
+                !ipow_less_equal(r, k, T(n - 1)))
+                return true;
+        }
+    }
 
-    return sieving_primes;
+    return false;
 }
 
-// In Sorenson's paper the semgent size is named ∆,
-// with ∆ = s / log(n). We also have ∆ = Θ(π(p) log n).
-// Sorenson's paper also mentions that using a larger
-// segment size improves performance. Hence, we use a
-// segment size of O(n^(1/4.5)).
-//
-uint64_t get_segment_size(uint128_t stop)
+/// Lp is the least non-square integer with Lp ≡ 1 (mod 8)
+/// that is a quadratic residue modulo all odd primes <= p.
+/// Here we check all of these conditions except minimality,
+/// which is infeasible to verify.
+///
+bool is_pseudosquare(uint128_t Lp, int p)
 {
-    // Default sieve array size = 256 kilobytes
-    uint64_t segment_size = (256 << 10) * Sieve::numbers_per_byte();
-    uint64_t root4_stop = (uint64_t) std::pow(stop, 1.0 / 4.5);
-    segment_size = std::max(segment_size, root4_stop);
-    return segment_size;
+    if ((Lp & 7) != 1)
+        return false;
+
+    uint128_t r = isqrt(Lp);
+    if (r * r == Lp)
+        return false;
+
+    for (std::size_t i = 1; primes[i] <= p; i++)
+    {
+        // Euler's criterion: a^((q-1)/2) ≡ 1 (mod q)
+        uint64_t q = primes[i];
+        uint64_t a = (uint64_t) (Lp % q);
+        uint64_t res = 1;
+
+        for (uint64_t e = (q - 1) / 2; e > 0; e--)
+            res = (res * a) % q;
+        if (res != 1)
+            return false;
+    }
+
+    return true;
 }
 
-void initialize(uint128_t stop,
-                uint64_t& delta,
-                uint64_t& s,
-                uint64_t& p,
-                bool verbose)
+uint128_t parse_uint128(const std::string& str)
 {
-    // In Sorenson's paper the segment size is named ∆,
-    // with ∆ = s / log(n). s is the upper bound for
-    // sieving, we sieve using the sieving primes <= s.
-    delta = get_segment_size(stop);
+    uint128_t n = 0;
+    uint128_t max_n = std::numeric_limits<uint128_t>::max();
 
-    double log_delta = std::log(delta);
-    log_delta = std::max(1.0, log_delta);
-    s = delta * log_delta;
-    uint128_t Lp;
+    if (str.empty())
+        throw std::runtime_error("invalid number: '" + str + "'");
 
-    // We have a list of known pseudosquares up to
-    // max(Lp) = L_373 ~ 4.2 * 10^24. Hence, using
-    // delta = n^(1/4.5) and s = delta * log(delta)
-    // we can sieve primes up to n:
-    // n / s < Lp
-    // n / (n^(1/4.5) * log(n^(1/4.5))) < 4.2 * 10^24
-    // n < 1.74083 * 10^33
-    if (stop / s >= pseudosquares.back().Lp)
-        throw std::runtime_error("n/s must be < max(Lp)");
-
-    // Pick the prime p so that Lp such that n/s < Lp
-    for (const auto& pss : pseudosquares)
+    for (char c : str)
     {
-        p = pss.p;
-        Lp = pss.Lp;
-        if (pss.Lp > stop / s)
-            break;
+        if (c < '0' || c > '9')
+            throw std::runtime_error("invalid number: '" + str + "'");
+        uint64_t digit = c - '0';
+        if (n > (max_n - digit) / 10)
+            throw std::runtime_error("number too large: '" + str + "'");
+        n = n * 10 + digit;
     }
 
-    if (verbose)
+    return n;
+}
+
+/// Append the pseudosquare Lp to our list of pseudosquares.
+/// Pseudosquares that are already known must match exactly,
+/// new pseudosquares must be added in order of increasing p.
+///
+void add_pseudosquare(uint128_t p, uint128_t Lp)
+{
+    if (p < 2 || p >= prime_pi.size() || prime_pi[p] == prime_pi[p - 1])
+        throw std::runtime_error("pseudosquares: p must be a prime < " + std::to_string(prime_pi.size()));
+
+    std::size_t i = prime_pi[p] - 1;
+
+    if (i < pseudosquares.size())
     {
-        std::cout << "Sieve size: " << delta / Sieve::numbers_per_byte() << " bytes" << std::endl;
-        std::cout << "delta: " << delta << std::endl;
-        std::cout << "s: " << s << " (max sieving prime)" << std::endl;
-        std::cout << "p: " << p << " (pseudosquare prime)" << std::endl;
-        std::cout << "Lp: " << Lp << " (pseudosquare)" << std::endl;
+        if (pseudosquares[i].Lp != Lp)
+            throw std::runtime_error("pseudosquares: L" + to_string(p) + " does not match the known pseudosquare");
+        return;
     }
+
+    if (i != pseudosquares.size())
+        throw std::runtime_error("pseudosquares: missing L" + std::to_string(primes[pseudosquares.size()]));
+    if (Lp > std::numeric_limits<uint128_t>::max() / 4)
+        throw std::runtime_error("pseudosquares: L" + to_string(p) + " must be < 2^126");
+    if (Lp < pseudosquares.back().Lp)
+        throw std::runtime_error("pseudosquares: L" + to_string(p) + " < L" + std::to_string(pseudosquares.back().p));
+    if (!is_pseudosquare(Lp, (int) p))
+        throw std::runtime_error("pseudosquares: " + to_string(Lp) + " is not a pseudosquare for p = " + to_string(p));
+
+    pseudosquares.push_back(Pseudosquare{(int) p, Lp});
 }
 
-// Sorenson's Pseudosquares Prime Test
-bool pseudosquares_prime_test(uint128_t n, int p)
+/// The sieving primes are stored as a structure of arrays
+/// because cross_off() visits all sieving primes in each
+/// segment and we want it to stream as little memory as
+/// possible. For each sieving prime we store the gap to the
+/// previous sieving prime divided by 2 in a uint8_t and the
+/// sieve index of its next multiple in a uint32_t. Hence we
+/// use 5 bytes per sieving prime instead of 8 bytes and the
+/// primes are decoded in a register while sieving. The gaps
+/// are either generated lazily using primesieve::iterator or
+/// memory mapped from the sieving primes cache file, see
+/// load_sieving_primes().
+///
+struct SievingPrimes
 {
-    ASSERT(p >= 2);
-    uint128_t e = (n - 1) >> 1;
-    uint128_t minus1 = n - 1;
+    // (prime - previous prime) / 2, the
+    // first sieving prime 3 is stored as 1.
+    Vector<uint8_t> gaps_buffer;
+    // Gaps from the sieving primes cache file
+    const uint8_t* mapped_gaps = nullptr;
+    std::size_t mapped_size = 0;
+    uint64_t mapped_limit = 0;
+    // Next multiple sieve index / 2, see encode_index().
+    // Contains one index per stored sieving prime.
+    Vector<uint32_t> indexes;
+    // Largest stored sieving prime
+    uint64_t back_prime = 1;
+    // The sieving primes used for the current interval
+    // are the first size_ stored sieving primes.
+    std::size_t size_ = 0;
+    // Largest sieving prime used for the current interval
+    uint64_t last_prime = 1;
+    // Uses all sieving primes <= limit
+    uint64_t limit = 0;
+    // generate() adds sieving primes <= max_prime
+    uint64_t max_prime = 0;
+    primesieve::iterator it;
+    uint64_t next_prime = 0;
 
-    // 2^((n−1)/2) mod n
-    uint128_t res = modpow<2>(e, n);
+    // Index has not been initialized yet
+    static constexpr uint32_t no_index = std::numeric_limits<uint32_t>::max();
 
-    // Condition (4) for n ≡ 1 mod 8: found -1 result
-    if ((n & 7) == 1 && res == minus1)
-        return true;
-    // Condition (4) for n ≡ 5 mod 8: 2^((n−1)/2) ≡ −1 mod n
-    if ((n & 7) == 5 && res != minus1)
-        return false;
-    // Condition (3): 2^((n−1)/2) ≡ ±1 mod n
-    if (res != 1 && res != minus1)
-        return false;
+    /// The sieving primes are memory mapped from the
+    /// cache file if it contains all primes <= max_prime.
+    ///
+    SievingPrimes(uint64_t max_prime, const SievingPrimesCache& cache)
+        : mapped_gaps(cache.gaps),
+          mapped_size(cache.size),
+          mapped_limit(cache.limit)
+    {
+        set_max_prime(max_prime);
+    }
 
-    // For 3 <= pi ≤ p: pi^((n−1)/2) mod n
-    for (std::size_t i = 1; primes[i] <= p; i++)
+    std::size_t size() const
     {
-        res = modpow(primes[i], e, n);
+        return size_;
+    }
 
-        // Condition (4) for n ≡ 1 mod 8: found -1 result
-        if ((n & 7) == 1 && res == minus1)
-            return true;
-        // Condition (3): pi^((n−1)/2) ≡ ±1 mod n
-        if (res != 1 && res != minus1)
-            return false;
+    const uint8_t* gaps() const
+    {
+        return mapped_gaps ? mapped_gaps : gaps_buffer.data();
     }
 
-    // Condition (4): for n ≡ 1 mod 8:
-    if ((n & 7) == 1)
+    /// Allow generate() to add the sieving primes <= n.
+    /// The sieving primes that have already been stored
+    /// are reused, hence this only grows our sieving primes.
+    ///
+    void set_max_prime(uint64_t n)
     {
-        // In case we have not found any -1 result so far,
-        // check all pi > p while Lpi <= n: pi^((n−1)/2) ≡ ±1 mod n
-        // This step is missing in Sorenson's paper. Sorenson
-        // confirmed it was a bug and suggested this fix.
-        for (std::size_t i = prime_pi[p] + 1; pseudosquares.at(i).Lp <= n; i++)
+        // We sieve using all sieving primes <= s (max_prime).
+        // Hence, s is the maximum sieving prime. We
+        // store the sieving prime gaps in uint8_t and
+        // the sieving indexes / 2 in uint32_t.
+        if (n > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("SievingPrimes: max_prime must be < 2^32");
+        if (n <= max_prime)
+            return;
+
+        // The cache file does not contain all sieving primes
+        // <= n, we copy the stored gaps and generate the
+        // remaining sieving primes using primesieve.
+        if (mapped_gaps && n > mapped_limit)
         {
-            res = modpow(primes[i], e, n);
+            gaps_buffer.insert(gaps_buffer.end(), mapped_gaps, mapped_gaps + indexes.size());
+            mapped_gaps = nullptr;
+        }
 
-            if (res == minus1)
-                return true;
-            if (res != 1)
+        if (!mapped_gaps)
+        {
+            // The 1st sieving prime is 3
+            it.jump_to(std::max(back_prime + 1, uint64_t(3)), n);
+            next_prime = it.next_prime();
+        }
+
+        max_prime = n;
+    }
+
+    /// Reset the sieving indexes of the current interval,
+    /// afterwards the stored sieving primes can be reused
+    /// for sieving another interval.
+    ///
+    void reset()
+    {
+        std::fill_n(indexes.data(), size_, no_index);
+        size_ = 0;
+        last_prime = 1;
+        limit = 0;
+    }
+
+    /// Use the sieving primes <= n. sieve_primes() calls
+    /// this method for each segment as sqrt(high) grows.
+    /// Hence the memory usage tracks the current segment
+    /// and the first segments are sieved without delay.
+    ///
+    void generate(uint64_t n)
+    {
+        n = std::min(n, max_prime);
+        if (n <= limit)
+            return;
+
+        while (size_ < indexes.size() || store_next_prime(n))
+        {
+            uint64_t prime = last_prime + uint64_t(gaps()[size_]) * 2;
+            if (prime > n)
+                break;
+            last_prime = prime;
+            size_++;
+        }
+
+        limit = n;
+    }
+
+    /// Store the next sieving prime if it is <= n.
+    /// The maximum prime gap below 2^32 is 336, hence
+    /// gap / 2 of our sieving primes < 2^32 always fits
+    /// into a uint8_t and we need no escape code.
+    ///
+    bool store_next_prime(uint64_t n)
+    {
+        uint64_t prime;
+
+        if (mapped_gaps)
+        {
+            if (indexes.size() >= mapped_size)
                 return false;
+            prime = back_prime + uint64_t(mapped_gaps[indexes.size()]) * 2;
+            if (prime > n)
+                return false;
+        }
+        else
+        {
+            prime = next_prime;
+            if (prime > n)
+                return false;
+            ASSERT(prime <= std::numeric_limits<uint32_t>::max());
+            uint64_t gap = (prime - back_prime) / 2;
+            ASSERT(gap <= std::numeric_limits<uint8_t>::max());
+            gaps_buffer.push_back((uint8_t) gap);
+            next_prime = it.next_prime();
         }
+
+        indexes.push_back(no_index);
+        back_prime = prime;
+        return true;
     }
 
-    return true;
+    /// The index of the next multiple of prime in the next
+    /// segment is < 2 * prime. Since we only cross off odd
+    /// multiples its parity is known from the parity of the
+    /// next segment's low, hence we only store index / 2 which
+    /// is < prime. This allows using sieving primes < 2^32.
+    ///
+    static uint32_t encode_index(uint64_t index)
+    {
+        ASSERT(index / 2 < no_index);
+        return (uint32_t) (index / 2);
+    }
+
+    /// low_odd = low % 2 of the current segment
+    static uint64_t decode_index(uint32_t index, uint64_t low_odd)
+    {
+        return uint64_t(index) * 2 + (low_odd ^ 1);
+    }
+};
+
+/// Square root rounded down to uint64_t. For n >= 2^128
+/// the result is saturated to max(uint64_t).
+///
+template <typename T>
+uint64_t sqrt_u64(const T& n)
+{
+    double r = std::sqrt((double) n);
+    if (r >= 18446744073709551615.0)
+        return std::numeric_limits<uint64_t>::max();
+    return (uint64_t) r;
 }
 
-} // namespace
+/// Tuning parameters measured by --tune, see set_host_profile()
+std::vector<ProfileBand> host_profile;
 
-// Sieve primes inside [start, stop]
-uint64_t pseudosquares_prime_sieve(uint128_t start,
-                                   uint128_t stop,
-                                   bool print_primes,
-                                   bool verbose)
+/// Memory budget in bytes of all threads, 0 = unlimited,
+/// see set_max_memory().
+///
+uint64_t max_memory = 0;
+
+/// Sieving is memory bound whereas the Pseudosquares Prime Test
+/// is multiplier bound. In pipeline mode the candidates of each
+/// segment are put into a bounded queue from which they are
+/// tested, possibly by another thread. pipeline > 0 threads
+/// prefer sieving and the other threads prefer testing,
+/// PIPELINE_AUTO threads all prefer testing and only sieve
+/// when the queue is empty. Threads fall back to the other
+/// kind of work instead of waiting, hence the pipeline cannot
+/// stall even if the thread pool is shared by many queries.
+///
+int pipeline = PIPELINE_OFF;
+
+/// Returns nullptr if no host profile has been loaded
+const ProfileBand* get_profile_band(double stop)
 {
-    // After having run sieving and the pseudosquares prime
-    // test, one has to remove perfect powers. Our implementation
-    // misses this final step and is hence limited to
-    // n <= 6.4 * 10^37 (according to Sorenson's paper).
-    //
-    // However, our implementation is also limited by the
-    // formula n / s < max(Lp) and since we only have a list of
-    // pseudosqaures up to max(Lp) = L_373 our implementation
-    // requires n <= 1.73 * 10^33, see initialize().
-    if ((double) stop > 1.73 * 1e33)
-        throw std::runtime_error("stop must be <= 1.73 * 10^33");
+    for (const ProfileBand& band : host_profile)
+        if (stop <= band.max_stop)
+            return &band;
 
-    uint64_t count = 0;
+    if (host_profile.empty())
+        return nullptr;
 
-    if (start < 2)
-        start = 2;
-    if (start > stop)
-        return 0;
-    if (start <= 2)
-    {
-        count++;
-        if (print_primes)
-            std::cout << 2 << "\n";
-        start = 3;
-        if (start > stop)
-            return count;
-    }
+    return &host_profile.back();
+}
 
-    // Same variable names as in Sorenson's paper
-    uint64_t delta, s, p;
-    initialize(stop, delta, s, p, verbose);
-    Sieve sieve(delta);
+// In Sorenson's paper the semgent size is named ∆,
+// with ∆ = s / log(n). We also have ∆ = Θ(π(p) log n).
+// Sorenson's paper also mentions that using a larger
+// segment size improves performance. Hence, we use a
+// segment size of O(n^(1/4.5)).
+//
+template <typename T>
+uint64_t get_segment_size(const T& stop)
+{
+    // Default sieve array size = 256 kilobytes
+    uint64_t sieve_size = 256 << 10;
+    const ProfileBand* band = get_profile_band((double) stop);
 
-    uint64_t sqrt_stop = (uint64_t) std::sqrt(stop);
-    uint64_t max_sieving_prime = std::min(s, sqrt_stop);
-    Vector<SievingPrime> sieving_primes = get_sieving_primes(max_sieving_prime);
+    if (band)
+        sieve_size = band->sieve_size;
 
-    for (uint128_t low = start; low <= stop; low += sieve.size())
-    {
-        // Sieve current segment [low, high]
-        uint128_t high = low + sieve.size() - 1;
-        high = std::min(high, stop);
-        uint64_t sqrt_high = (uint64_t) std::sqrt(high);
-        uint64_t max_i = uint64_t(high - low) + 1;
-        max_sieving_prime = std::min(s, sqrt_high);
-        sieve.set_all_bits();
+    uint64_t segment_size = sieve_size * Sieve::numbers_per_byte();
+    uint64_t root4_stop = (uint64_t) std::pow((double) stop, 1.0 / 4.5);
+    segment_size = std::max(segment_size, root4_stop);
+    return segment_size;
+}
 
-        // Sieve out multiples of primes <= s
-        for (auto& sp : sieving_primes)
-        {
-            uint64_t prime = sp.prime;
-            uint64_t i = sp.i;
+/// Intervals smaller than the segment size are sieved
+/// using a single segment that is sized to the interval.
+///
+template <typename T>
+uint64_t clamp_segment_size(const T& start,
+                            const T& stop,
+                            uint64_t segment_size)
+{
+    if (stop - start < segment_size)
+        segment_size = uint64_t(stop - start) + 1;
 
-            if (prime > max_sieving_prime)
-                break;
-            if (sp.i == -1)
-            {
-                uint128_t q = low / prime;
-                uint128_t n = q * prime;
-                uint128_t pp = uint64_t(prime) * prime;
-                n += prime & -(n < low);
-                n += prime & -((n & 1) == 0);
-                n = std::max(n, pp);
-                ASSERT(n % 2 == 0);
-                i = uint64_t(n - low);
-            }
+    return segment_size;
+}
+
+/// Returns the smallest pseudosquare prime p with Lp > n / s.
+/// If the number n has no prime factors <= s and n / s < Lp
+/// then the Pseudosquares Prime Test only needs to use the
+/// prime bases <= p. Since Lp grows exponentially, numbers
+/// far below stop require fewer bases than stop itself.
+///
+template <typename T>
+const Pseudosquare& get_pseudosquare(const T& n, uint64_t s)
+{
+    T n_s = n / s;
 
-            for (; i < max_i; i += prime * 2)
-                sieve.unset_bit(i);
+    for (const auto& pss : pseudosquares)
+        if (pss.Lp > n_s)
+            return pss;
 
-            sp.set_index(i - max_i);
-        }
+    // We have a list of known pseudosquares up to
+    // max(Lp) = L_373 ~ 4.2 * 10^24. As find_tuning()
+    // uses s <= 2^32 - 1, n / s < max(Lp) allows sieving
+    // up to n < max(Lp) * (2^32 - 1) ~ 1.8 * 10^34.
+    // Larger pseudosquares can be loaded from a file
+    // using load_pseudosquares().
+    throw std::runtime_error("n/s must be < max(Lp) = L" + std::to_string(pseudosquares.back().p));
+}
+
+/// Cross off the odd multiples of the sieving primes with
+/// indexes [first, last[ that are <= max_sieving_prime.
+/// prime is the sieving prime preceding first (or 1). We
+/// sieve the sieve indexes [start_i, stop_i[ of the segment
+/// starting at low. The sieving prime indexes are relative
+/// to start_i, after sieving they are relative to stop_i.
+/// Returns the last decoded sieving prime.
+///
+template <typename T>
+uint64_t cross_off(Sieve& sieve,
+                   SievingPrimes& sieving_primes,
+                   std::size_t first,
+                   std::size_t last,
+                   uint64_t prime,
+                   const T& low,
+                   uint64_t start_i,
+                   uint64_t stop_i,
+                   uint64_t max_sieving_prime)
+{
+    T block_low = low + start_i;
+    uint64_t low_odd = uint64_t(block_low & 1);
+    uint64_t max_i = stop_i - start_i;
+    const uint8_t* gaps = sieving_primes.gaps();
+    uint32_t* indexes = sieving_primes.indexes.data();
+
+    for (std::size_t k = first; k < last; k++)
+    {
+        prime += uint64_t(gaps[k]) * 2;
+        uint64_t i;
 
-        for (uint128_t n = low + (~low & 1); n <= high; n += 2)
+        if (prime > max_sieving_prime)
+            break;
+        if (indexes[k] != SievingPrimes::no_index)
+            i = SievingPrimes::decode_index(indexes[k], low_odd);
+        else
         {
-            // sieve[n]=true is a potential prime
-            if (sieve[n - low])
-            {
-                if (max_sieving_prime >= sqrt_high)
-                {
-                    count++;
-                    if (print_primes)
-                        std::cout << n << "\n";
-                }
-                else if (pseudosquares_prime_test(n, p))
-                {
-                    count++;
-                    if (print_primes)
-                        std::cout << n << "\n";
-                }
-            }
+            // Find the first odd multiple of prime >= block_low.
+            // The sieve index is relative to block_low, hence we
+            // only need block_low % prime which is computed using
+            // 64-bit reductions even if block_low is a WideUint.
+            uint64_t r = mod_u64(block_low, prime);
+            i = (r == 0) ? 0 : prime - r;
+            i += prime & (0 - uint64_t(((low_odd + i) & 1) == 0));
+
+            // Start crossing off at prime^2
+            uint64_t pp = prime * prime;
+            if (block_low < pp)
+                i = std::max(i, pp - uint64_t(block_low));
+
+            ASSERT(((low_odd + i) & 1) == 1);
         }
+
+        for (; i < max_i; i += prime * 2)
+            sieve.unset_bit(start_i + i);
+
+        indexes[k] = SievingPrimes::encode_index(i - max_i);
     }
 
-    return count;
+    return prime;
+}
+
+/// Cross off the odd multiples of the sieving primes
+/// <= max_sieving_prime inside the segment [low, low + max_i[.
+/// Once the segment is larger than the CPU's L1 cache, small
+/// sieving primes with many multiples per segment would evict
+/// each other's cache lines. Hence the first small_primes
+/// sieving primes are applied block by block, where each
+/// block fits into the L1 cache. The remaining sieving primes
+/// have few multiples per block and are applied to the whole
+/// segment at once.
+///
+template <typename T>
+void cross_off(Sieve& sieve,
+               SievingPrimes& sieving_primes,
+               std::size_t small_primes,
+               uint64_t block_size,
+               const T& low,
+               uint64_t max_i,
+               uint64_t max_sieving_prime)
+{
+    std::size_t size = sieving_primes.size();
+    std::size_t middle = std::min(small_primes, size);
+    uint64_t prime = 1;
+
+    for (uint64_t i = 0; i < max_i; i += block_size)
+    {
+        uint64_t stop_i = std::min(i + block_size, max_i);
+        prime = cross_off(sieve, sieving_primes, 0, middle, 1,
+                          low, i, stop_i, max_sieving_prime);
+    }
+
+    // If the previous loop stopped early because prime >
+    // max_sieving_prime this returns immediately too.
+    cross_off(sieve, sieving_primes, middle, size, prime,
+              low, 0, max_i, max_sieving_prime);
+}
+
+/// Number of sieving primes that are applied block by block,
+/// these are the sieving primes with at least 8 multiples
+/// per block.
+///
+std::size_t get_small_primes(const SievingPrimes& sieving_primes,
+                             uint64_t block_size)
+{
+    uint64_t max_prime = block_size / 16;
+    uint64_t prime = 1;
+    std::size_t small_primes = 0;
+
+    for (; small_primes < sieving_primes.size(); small_primes++)
+    {
+        prime += uint64_t(sieving_primes.gaps()[small_primes]) * 2;
+        if (prime > max_prime)
+            break;
+    }
+
+    return small_primes;
+}
+
+/// Measured runtimes in seconds of the basic operations
+/// of the Pseudosquares Prime Sieve on the current CPU.
+/// These are used to choose the maximum sieving prime s.
+///
+struct Costs
+{
+    // Generating the sieving primes, per number <= s
+    double generate;
+    // Loading the sieving primes from the sieving
+    // primes cache file, per number <= s
+    double load;
+    // Crossing off one multiple of a sieving prime
+    double cross_off;
+    // Processing one sieving prime in one segment
+    double visit;
+    // Computing the index of the first multiple of
+    // one sieving prime in the 1st segment
+    double init;
+    // One modular exponentiation of a number near stop
+    double modpow;
+};
+
+/// These costs only depend on the CPU, hence
+/// they are measured only once.
+///
+Costs measure_sieve_costs()
+{
+    using Clock = std::chrono::steady_clock;
+    using Seconds = std::chrono::duration<double>;
+    Costs costs;
+
+    uint64_t n = 1 << 20;
+    auto t1 = Clock::now();
+    SievingPrimes sieving_primes(n, SievingPrimesCache());
+    sieving_primes.generate(n);
+    auto t2 = Clock::now();
+    costs.generate = Seconds(t2 - t1).count() / n;
+
+    // Sieve 2 segments of size 2^20 using the sieving primes
+    // <= 2^10, then 2 segments of size 2^12 using the sieving
+    // primes <= 2^20. We time the 2nd segment of each run
+    // because the 1st segment initializes the indexes.
+    uint64_t low = uint64_t(1) << 40;
+    uint64_t small_primes = 1 << 10;
+    uint64_t block_size = get_l1_cache_size() * Sieve::numbers_per_byte();
+    std::size_t small = get_small_primes(sieving_primes, block_size);
+    Sieve sieve(n);
+    sieve.set_all_bits();
+    cross_off(sieve, sieving_primes, small, block_size, low, n, small_primes);
+    auto t3 = Clock::now();
+    cross_off(sieve, sieving_primes, small, block_size, low + n, n, small_primes);
+    auto t4 = Clock::now();
+
+    // The number of crossed off odd multiples is
+    // n/2 * sum 1/p for 3 <= p <= 2^10.
+    double multiples = n / 2.0 * (std::log(std::log(small_primes)) - std::log(std::log(3.0)));
+    costs.cross_off = Seconds(t4 - t3).count() / multiples;
+
+    uint64_t m = 1 << 12;
+    low += n * 2;
+    Sieve small_sieve(m);
+    small_sieve.set_all_bits();
+    cross_off(small_sieve, sieving_primes, small, block_size, low, m, n);
+    auto t5 = Clock::now();
+    cross_off(small_sieve, sieving_primes, small, block_size, low + m, m, n);
+    auto t6 = Clock::now();
+    costs.visit = Seconds(t6 - t5).count() / sieving_primes.size();
+
+    return costs;
+}
+
+template <typename T>
+Costs measure_costs(const T& stop)
+{
+    using Clock = std::chrono::steady_clock;
+    using Seconds = std::chrono::duration<double>;
+
+    // Thread-safe initialization in C++11
+    static const Costs sieve_costs = measure_sieve_costs();
+    Costs costs = sieve_costs;
+
+    // Small intervals are sieved using a single segment,
+    // there computing the first multiple of each sieving
+    // prime (low % prime) dominates.
+    uint64_t n = 1 << 16;
+    auto t1 = Clock::now();
+    SievingPrimes sieving_primes(n, get_sieving_primes_cache());
+    sieving_primes.generate(n);
+    auto t2 = Clock::now();
+    costs.load = costs.generate;
+
+    if (n <= get_sieving_primes_cache().limit)
+        costs.load = Seconds(t2 - t1).count() / n;
+
+    Sieve sieve(1);
+    sieve.set_all_bits();
+    auto t3 = Clock::now();
+    cross_off(sieve, sieving_primes, 0, 1, stop - n, 1, n);
+    auto t4 = Clock::now();
+    costs.init = Seconds(t4 - t3).count() / sieving_primes.size();
+
+    // Modular exponentiation of odd numbers <= stop,
+    // as used by the Pseudosquares Prime Test.
+    std::size_t count = 64;
+    Vector<T> exponents(count);
+    Vector<T> moduli(count);
+    Vector<T> results(count);
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        moduli[i] = (stop - 1 - T(i * 2)) | 1;
+        exponents[i] = (moduli[i] - 1) >> 1;
+    }
+
+    // Use the fastest of 3 runs to reduce timing noise
+    for (int i = 0; i < 3; i++)
+    {
+        auto t5 = Clock::now();
+        modpow_batch(3, exponents.data(), moduli.data(), results.data(), count);
+        auto t6 = Clock::now();
+        double seconds = Seconds(t6 - t5).count() / count;
+        costs.modpow = (i == 0) ? seconds : std::min(costs.modpow, seconds);
+    }
+
+    return costs;
+}
+
+const double euler_gamma = 0.5772156649015329;
+
+/// Smallest segment size used to fit a memory budget
+const uint64_t min_delta = 1 << 16;
+
+/// Estimated memory usage in bytes of a thread that sieves up
+/// to stop using the sieving primes <= s and the segment size
+/// delta. Vectors that grow using push_back() may use up to
+/// twice their size.
+///
+template <typename T>
+double estimate_memory(const T& stop, uint64_t s, uint64_t delta)
+{
+    uint64_t sqrt_stop = sqrt_u64(stop);
+    double max_sieving_prime = (double) std::min(s, sqrt_stop);
+    double pi_s = max_sieving_prime / std::max(1.0, std::log(max_sieving_prime) - 1.1);
+
+    // The sieve array and the sieving primes, the gaps of
+    // the sieving primes cache file are memory mapped.
+    double memory = (double) delta / Sieve::numbers_per_byte();
+    double bytes_per_sieving_prime = sizeof(uint32_t);
+
+    if (max_sieving_prime > get_sieving_primes_cache().limit)
+        bytes_per_sieving_prime += sizeof(uint8_t);
+
+    memory += 2 * pi_s * bytes_per_sieving_prime;
+
+    // The candidates of a segment (numbers without prime
+    // factors <= s), the Pseudosquares Prime Test needs 3
+    // more numbers per candidate. In pipeline mode up to
+    // 2 more batches of candidates per thread are queued.
+    double candidates = delta / std::log((double) stop);
+    double bytes_per_candidate = 2 * sizeof(T);
+
+    if (s < sqrt_stop)
+    {
+        candidates = delta * std::exp(-euler_gamma) / std::log(s);
+        bytes_per_candidate += 3 * sizeof(T) + sizeof(uint8_t) + sizeof(uint32_t);
+    }
+
+    if (pipeline != PIPELINE_OFF)
+        bytes_per_candidate += 4 * sizeof(T);
+
+    memory += candidates * bytes_per_candidate;
+
+    return memory;
+}
+
+/// Estimated runtime in seconds for sieving [start, stop]
+/// using the sieving primes <= s.
+///
+struct Tuning
+{
+    uint64_t s;
+    uint64_t delta;
+    int p;
+    double memory;
+    double generate;
+    double sieve;
+    double test;
+
+    double total() const
+    {
+        return generate + sieve + test;
+    }
+};
+
+/// Returns false if n / s >= max(Lp) or if the
+/// memory usage exceeds max_memory > 0.
+///
+template <typename T>
+bool estimate(const T& start,
+              const T& stop,
+              uint64_t s,
+              const Costs& costs,
+              uint64_t max_memory,
+              Tuning& tuning)
+{
+    // Sorenson's paper uses ∆ = s / log(n), for large s
+    // this keeps the number of sieving primes per segment
+    // proportional to the segment size.
+    uint64_t delta = get_segment_size(stop);
+    delta = std::max(delta, (uint64_t) (s / std::log(s)));
+    delta = clamp_segment_size(start, stop, delta);
+    tuning.memory = estimate_memory(stop, s, delta);
+
+    // Smaller segments use less memory, but each segment
+    // needs to process all sieving primes.
+    while (max_memory > 0 &&
+           tuning.memory > max_memory &&
+           delta > min_delta)
+    {
+        delta = std::max(delta / 2, min_delta);
+        tuning.memory = estimate_memory(stop, s, delta);
+    }
+
+    if (max_memory > 0 &&
+        tuning.memory > max_memory)
+        return false;
+
+    uint64_t sqrt_stop = sqrt_u64(stop);
+    double max_sieving_prime = (double) std::min(s, sqrt_stop);
+    double pi_s = max_sieving_prime / (std::log(max_sieving_prime) - 1.1);
+    double len = (double) (stop - start) + 1;
+    double segments = std::max(1.0, len / delta);
+    double sum_inverse_primes = std::log(std::log(max_sieving_prime)) - std::log(std::log(3.0));
+
+    tuning.s = s;
+    tuning.delta = delta;
+    tuning.p = 0;
+    tuning.generate = costs.generate * max_sieving_prime;
+
+    if (max_sieving_prime <= get_sieving_primes_cache().limit)
+        tuning.generate = costs.load * max_sieving_prime;
+
+    tuning.sieve = costs.init * pi_s +
+                   costs.visit * pi_s * (segments - 1) +
+                   costs.cross_off * len / 2 * sum_inverse_primes;
+    tuning.test = 0;
+
+    if (s < sqrt_stop)
+    {
+        if (stop / s >= pseudosquares.back().Lp)
+            return false;
+
+        // By Mertens' theorem a fraction of e^-γ / log(s) of
+        // the numbers have no prime factors <= s. Composites
+        // usually fail the 1st prime base, primes require
+        // all prime bases <= p.
+        tuning.p = get_pseudosquare(stop, s).p;
+        double survivors = len * std::exp(-euler_gamma) / std::log(s);
+        double primes = len / std::log((double) stop);
+        tuning.test = costs.modpow * (survivors + primes * (prime_pi[tuning.p] - 1));
+    }
+
+    return true;
+}
+
+/// Buffers of the batched Pseudosquares Prime Test
+template <typename T>
+struct TestBuffers
+{
+    Vector<T> candidates;
+    Vector<T> exponents;
+    Vector<T> moduli;
+    Vector<T> results;
+};
+
+/// The sieve array, the sieving primes and the buffers of
+/// the Pseudosquares Prime Test are kept in SieveState so
+/// that they can be reused for sieving many intervals,
+/// see PseudosquaresSieve. The buffers only grow.
+///
+struct SieveState
+{
+    Sieve sieve = Sieve(0);
+    std::unique_ptr<SievingPrimes> sieving_primes;
+    uint64_t cache_generation = 0;
+    TestBuffers<uint128_t> buffers128;
+    TestBuffers<uint256_t> buffers256;
+    Vector<uint32_t> active;
+    Vector<uint8_t> is_prime;
+    // Memory budget of the thread using this state,
+    // 0 = use max_memory (single-threaded).
+    uint64_t thread_memory = 0;
+
+    template <typename T>
+    TestBuffers<T>& buffers()
+    {
+        if constexpr (std::is_same<T, uint128_t>::value)
+            return buffers128;
+        else
+            return buffers256;
+    }
+};
+
+/// The costs mostly depend on the size of the numbers,
+/// hence they are measured only once per process for each
+/// number of bits of stop (and sieving primes cache file).
+/// All threads and shards of a run use the same costs and
+/// hence choose the same s and prime bases.
+///
+template <typename T>
+const Costs& get_costs(const T& stop)
+{
+    int bits = (int) std::log2((double) stop);
+    uint64_t generation = get_sieving_primes_cache().generation;
+    auto key = std::make_pair(bits, generation);
+
+    static std::map<std::pair<int, uint64_t>, Costs> costs;
+    static std::mutex costs_mutex;
+    std::lock_guard<std::mutex> lock(costs_mutex);
+    auto iter = costs.find(key);
+
+    if (iter == costs.end())
+        iter = costs.emplace(key, measure_costs(stop)).first;
+
+    return iter->second;
+}
+
+/// In Sorenson's paper the segment size is named ∆,
+/// with ∆ = s / log(n). s is the upper bound for
+/// sieving, we sieve using the sieving primes <= s.
+///
+template <typename T>
+uint64_t get_sorenson_s(const T& stop, uint64_t& delta)
+{
+    delta = get_segment_size(stop);
+
+    double log_delta = std::log(delta);
+    log_delta = std::max(1.0, log_delta);
+    uint64_t s = delta * log_delta;
+
+    // Sieving primes must be < 2^32, see SievingPrimes.
+    // If this limit is reached we reduce delta so that
+    // the memory usage remains O(log(n)^2).
+    uint64_t max_s = std::numeric_limits<uint32_t>::max();
+
+    if (s > max_s)
+    {
+        s = max_s;
+        delta = (uint64_t) (s / std::log(s));
+    }
+
+    return s;
+}
+
+/// A larger s requires more sieving but reduces the number
+/// of candidates and the pseudosquare prime p, hence fewer
+/// prime bases need to be tested. Generating the sieving
+/// primes <= s is expensive for small intervals. Returns
+/// the tuning with the smallest estimated runtime that uses
+/// at most max_memory > 0 bytes.
+///
+template <typename T>
+bool find_tuning(const T& start,
+                 const T& stop,
+                 const Costs& costs,
+                 uint64_t max_memory,
+                 Tuning& best)
+{
+    uint64_t delta;
+    uint64_t max_s = std::numeric_limits<uint32_t>::max();
+    uint64_t s = get_sorenson_s(stop, delta);
+    bool found = estimate(start, stop, s, costs, max_memory, best);
+    Tuning tuning;
+
+    for (int k = 10; k <= 32; k++)
+    {
+        uint64_t x = std::min(uint64_t(1) << k, max_s);
+
+        if (estimate(start, stop, x, costs, max_memory, tuning) &&
+            (!found || tuning.total() < best.total()))
+        {
+            best = tuning;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+/// Smallest memory usage in bytes of a thread that sieves up
+/// to stop, using the smallest segment size and the smallest
+/// s with n / s < max(Lp).
+///
+template <typename T>
+double get_min_memory(const T& stop)
+{
+    uint64_t max_s = std::numeric_limits<uint32_t>::max();
+    double min_memory = std::numeric_limits<double>::max();
+
+    for (int k = 10; k <= 32; k++)
+    {
+        uint64_t s = std::min(uint64_t(1) << k, max_s);
+        if (s < sqrt_u64(stop) && stop / s >= pseudosquares.back().Lp)
+            continue;
+        min_memory = std::min(min_memory, estimate_memory(stop, s, min_delta));
+    }
+
+    return min_memory;
+}
+
+std::string to_mib(double bytes)
+{
+    return std::to_string((uint64_t) std::ceil(bytes / (1 << 20))) + " MiB";
+}
+
+template <typename T>
+void initialize(SieveState& state,
+                const T& start,
+                const T& stop,
+                uint64_t& delta,
+                uint64_t& s,
+                bool verbose)
+{
+    uint64_t memory = (state.thread_memory > 0) ? state.thread_memory : max_memory;
+    s = get_sorenson_s(stop, delta);
+    delta = clamp_segment_size(start, stop, delta);
+
+    // No Pseudosquares Prime Test is needed
+    if (s >= sqrt_u64(stop) &&
+        (memory == 0 || estimate_memory(stop, s, delta) <= memory))
+    {
+        if (verbose)
+        {
+            std::cout << "Sieve size: " << delta / Sieve::numbers_per_byte() << " bytes" << std::endl;
+            std::cout << "delta: " << delta << std::endl;
+            std::cout << "s: " << s << " (max sieving prime)" << std::endl;
+            if (memory > 0)
+                std::cout << "Memory: " << to_mib(estimate_memory(stop, s, delta)) << " per thread (estimated)" << std::endl;
+        }
+        return;
+    }
+
+    // We measure the cost of sieving and testing on the
+    // current CPU and choose the s (and with a memory
+    // budget the delta) that minimizes the estimated runtime.
+    const Costs& costs = get_costs(stop);
+    Tuning best;
+
+    if (!find_tuning(start, stop, costs, memory, best))
+    {
+        // n / s >= max(Lp) for all s, throws an exception
+        get_pseudosquare(stop, std::numeric_limits<uint32_t>::max());
+        throw std::runtime_error("max-memory: requires at least " +
+            to_mib(get_min_memory(stop)) + " per thread");
+    }
+
+    s = best.s;
+    delta = best.delta;
+
+    // The pseudosquare prime p is selected for each
+    // segment, p(stop) is the largest p we will use.
+    const Pseudosquare& pss = get_pseudosquare(stop, s);
+
+    if (verbose)
+    {
+        std::cout << "Sieve size: " << delta / Sieve::numbers_per_byte() << " bytes" << std::endl;
+        std::cout << "delta: " << delta << std::endl;
+        std::cout << "s: " << s << " (max sieving prime)" << std::endl;
+        std::cout << "p: " << pss.p << " (max pseudosquare prime)" << std::endl;
+        std::cout << "Lp: " << pss.Lp << " (pseudosquare)" << std::endl;
+        if (memory > 0)
+            std::cout << "Memory: " << to_mib(best.memory) << " per thread (estimated)" << std::endl;
+        std::cout << "Estimated seconds: " << std::fixed << std::setprecision(3)
+                  << best.generate << " sieving primes, "
+                  << best.sieve << " sieve, "
+                  << best.test << " prime test" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
+
+// Sorenson's Pseudosquares Prime Test
+template <typename T>
+bool pseudosquares_prime_test(const T& n, int p)
+{
+    ASSERT(p >= 2);
+    T e = (n - 1) >> 1;
+    T minus1 = n - 1;
+    uint64_t n_mod8 = (uint64_t) (n & 7);
+
+    // 2^((n−1)/2) mod n
+    T res = modpow<2>(e, n);
+
+    // Condition (4) for n ≡ 1 mod 8: found -1 result
+    if (n_mod8 == 1 && res == minus1)
+        return true;
+    // Condition (4) for n ≡ 5 mod 8: 2^((n−1)/2) ≡ −1 mod n
+    if (n_mod8 == 5 && res != minus1)
+        return false;
+    // Condition (3): 2^((n−1)/2) ≡ ±1 mod n
+    if (res != 1 && res != minus1)
+        return false;
+
+    // For 3 <= pi ≤ p: pi^((n−1)/2) mod n
+    for (std::size_t i = 1; primes[i] <= p; i++)
+    {
+        res = modpow(primes[i], e, n);
+
+        // Condition (4) for n ≡ 1 mod 8: found -1 result
+        if (n_mod8 == 1 && res == minus1)
+            return true;
+        // Condition (3): pi^((n−1)/2) ≡ ±1 mod n
+        if (res != 1 && res != minus1)
+            return false;
+    }
+
+    // Condition (4): for n ≡ 1 mod 8:
+    if (n_mod8 == 1)
+    {
+        // In case we have not found any -1 result so far,
+        // check all pi > p while Lpi <= n: pi^((n−1)/2) ≡ ±1 mod n
+        // This step is missing in Sorenson's paper. Sorenson
+        // confirmed it was a bug and suggested this fix.
+        for (std::size_t i = prime_pi[p] + 1; pseudosquares.at(i).Lp <= n; i++)
+        {
+            res = modpow(primes[i], e, n);
+
+            if (res == minus1)
+                return true;
+            if (res != 1)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/// Sorenson's Pseudosquares Prime Test for all candidates of
+/// a segment. This computes the same result as running
+/// pseudosquares_prime_test() for each candidate, but the
+/// prime bases are tested one at a time for all candidates
+/// that are still undecided. This way the modular
+/// exponentiations of different candidates are independent
+/// and modpow_batch() can compute them in SIMD lanes.
+///
+template <typename T>
+void pseudosquares_prime_test(const Vector<T>& candidates,
+                              int p,
+                              bool simd,
+                              Vector<uint8_t>& is_prime,
+                              Vector<uint32_t>& active,
+                              Vector<T>& exponents,
+                              Vector<T>& moduli,
+                              Vector<T>& results)
+{
+    ASSERT(p >= 2);
+    std::size_t size = candidates.size();
+    std::size_t pi_p = prime_pi[p];
+    is_prime.resize(size);
+    active.resize(size);
+
+    // Candidates are primes unless proven otherwise
+    for (std::size_t k = 0; k < size; k++)
+    {
+        is_prime[k] = true;
+        active[k] = (uint32_t) k;
+    }
+
+    for (std::size_t i = 0; !active.empty(); i++)
+    {
+        std::size_t j = 0;
+
+        if (i == pi_p)
+        {
+            // All prime bases <= p have been tested. For
+            // n ≡ 1 mod 8, in case we have not found any -1
+            // result so far, check all pi > p while Lpi <= n,
+            // see pseudosquares_prime_test().
+            i++;
+            for (std::size_t k = 0; k < active.size(); k++)
+                if ((uint64_t) (candidates[active[k]] & 7) == 1)
+                    active[j++] = active[k];
+            active.resize(j);
+            j = 0;
+            if (active.empty())
+                break;
+        }
+
+        if (i > pi_p)
+        {
+            const T& Lp = pseudosquares.at(i).Lp;
+            for (std::size_t k = 0; k < active.size(); k++)
+                if (Lp <= candidates[active[k]])
+                    active[j++] = active[k];
+            active.resize(j);
+            j = 0;
+            if (active.empty())
+                break;
+        }
+
+        exponents.resize(active.size());
+        moduli.resize(active.size());
+        results.resize(active.size());
+
+        for (std::size_t k = 0; k < active.size(); k++)
+        {
+            moduli[k] = candidates[active[k]];
+            exponents[k] = (moduli[k] - 1) >> 1;
+        }
+
+        // pi^((n−1)/2) mod n
+        modpow_batch((uint64_t) primes[i], exponents.data(),
+                     moduli.data(), results.data(), active.size(), simd);
+
+        for (std::size_t k = 0; k < active.size(); k++)
+        {
+            const T& res = results[k];
+            T minus1 = moduli[k] - 1;
+            uint64_t n_mod8 = (uint64_t) (moduli[k] & 7);
+
+            if (i < pi_p)
+            {
+                // Condition (4) for n ≡ 1 mod 8: found -1 result
+                if (n_mod8 == 1 && res == minus1)
+                    continue;
+                // Condition (4) for n ≡ 5 mod 8: 2^((n−1)/2) ≡ −1 mod n
+                // Condition (3): pi^((n−1)/2) ≡ ±1 mod n
+                if ((i == 0 && n_mod8 == 5 && res != minus1) ||
+                    (res != 1 && res != minus1))
+                {
+                    is_prime[active[k]] = false;
+                    continue;
+                }
+            }
+            else
+            {
+                if (res == minus1)
+                    continue;
+                if (res != 1)
+                {
+                    is_prime[active[k]] = false;
+                    continue;
+                }
+            }
+
+            // Still undecided, test the next prime base
+            active[j++] = active[k];
+        }
+
+        active.resize(j);
+    }
+}
+
+/// Result of sieving a segment
+struct Segment
+{
+    // If p > 0 the candidates must be tested using
+    // pseudosquares_prime_test() with this p.
+    int p = 0;
+    uint64_t max_sieving_prime = 0;
+    // Number of primes if p = 0
+    uint64_t primes = 0;
+    bool is_last = false;
+    // Use the SIMD modpow kernel, see ProfileBand
+    bool simd = true;
+};
+
+/// Sieves the segments of [start, stop] one at a time, the
+/// Pseudosquares Prime Test of the candidates is done by the
+/// caller. This way sieving and testing can also be run on
+/// different threads, see sieve_primes_pipeline().
+///
+template <typename T>
+class SegmentedSieve
+{
+public:
+    /// Requires start >= 3
+    SegmentedSieve(SieveState& state,
+                   const T& start,
+                   const T& stop,
+                   bool verbose)
+        : sieve_(state.sieve),
+          low_(start),
+          stop_(stop)
+    {
+        ASSERT(start >= 3);
+        TraceScope trace("setup");
+        // Same variable names as in Sorenson's paper
+        uint64_t delta;
+        initialize(state, start, stop, delta, s_, verbose);
+        sieve_.resize(delta);
+
+        uint64_t sqrt_stop = sqrt_u64(stop);
+        uint64_t max_sieving_prime = std::min(s_, sqrt_stop);
+
+        // The sieving primes are created again if another
+        // (or a NUMA node local) cache file is used.
+        const SievingPrimesCache& cache = get_sieving_primes_cache();
+
+        if (!state.sieving_primes ||
+            state.cache_generation != cache.generation)
+        {
+            state.sieving_primes.reset(new SievingPrimes(max_sieving_prime, cache));
+            state.cache_generation = cache.generation;
+        }
+
+        sieving_primes_ = state.sieving_primes.get();
+        sieving_primes_->reset();
+        sieving_primes_->set_max_prime(max_sieving_prime);
+        block_size_ = get_l1_cache_size() * Sieve::numbers_per_byte();
+
+        // The other sieving primes are generated as needed
+        sieving_primes_->generate(block_size_ / 16);
+        small_primes_ = get_small_primes(*sieving_primes_, block_size_);
+
+        const ProfileBand* band = get_profile_band((double) stop);
+        simd_ = !band || band->avx512_ifma;
+    }
+
+    bool finished() const
+    {
+        return low_ > stop_;
+    }
+
+    /// Sieve the next segment. The primes and potential primes
+    /// are stored in candidates, unless no Pseudosquares Prime
+    /// Test is needed and extract_primes = false, then the
+    /// primes are only counted.
+    ///
+    Segment next(Vector<T>& candidates, bool extract_primes)
+    {
+        ASSERT(!finished());
+        SievingPrimes& sieving_primes = *sieving_primes_;
+        Sieve& sieve = sieve_;
+        Segment segment;
+
+        // Sieve current segment [low, high]
+        T low = low_;
+        T high = low + sieve.size() - 1;
+        high = std::min(high, stop_);
+        uint64_t sqrt_high = sqrt_u64(high);
+        uint64_t max_i = uint64_t(high - low) + 1;
+        uint64_t low_odd = uint64_t(low & 1);
+        uint64_t max_sieving_prime = std::min(s_, sqrt_high);
+        segment.max_sieving_prime = max_sieving_prime;
+        segment.simd = simd_;
+        low_ += sieve.size();
+        segment.is_last = finished();
+
+        // Pick the smallest pseudosquare prime p
+        // with Lp > high / s for the current segment.
+        if (max_sieving_prime < sqrt_high)
+            segment.p = get_pseudosquare(high, s_).p;
+
+        // Sieve out multiples of primes <= s
+        {
+            PerfScope perf(PERF_SIEVE);
+            TraceScope trace("sieve");
+            sieving_primes.generate(max_sieving_prime);
+            sieve.set_all_bits();
+            cross_off(sieve, sieving_primes, small_primes_, block_size_,
+                      low, max_i, max_sieving_prime);
+        }
+
+        PerfScope perf(PERF_EXTRACT);
+        TraceScope trace("extract");
+
+        // sieve[i]=true is a prime
+        if (segment.p == 0 &&
+            !extract_primes)
+        {
+            segment.primes = sieve.count(low_odd ^ 1, max_i);
+            return segment;
+        }
+
+        candidates.clear();
+
+        // sieve[i]=true is a prime or a potential prime
+        sieve.for_each_bit(low_odd ^ 1, max_i, [&](uint64_t i) {
+            candidates.push_back(low + i);
+        });
+
+        segment.primes = candidates.size();
+        return segment;
+    }
+
+private:
+    Sieve& sieve_;
+    SievingPrimes* sieving_primes_ = nullptr;
+    T low_;
+    T stop_;
+    uint64_t s_ = 0;
+    uint64_t block_size_ = 0;
+    std::size_t small_primes_ = 0;
+    bool simd_ = true;
+};
+
+/// Run the Pseudosquares Prime Test on the candidates of a
+/// segment, the primes are moved to the front of candidates.
+/// Returns the number of primes.
+///
+template <typename T>
+std::size_t test_candidates(SieveState& state,
+                            Vector<T>& candidates,
+                            const Segment& segment)
+{
+    ASSERT(segment.p > 0);
+    PerfScope perf(PERF_TEST);
+    TraceScope trace("test");
+    TestBuffers<T>& buffers = state.buffers<T>();
+    pseudosquares_prime_test(candidates, segment.p, segment.simd, state.is_prime, state.active,
+                             buffers.exponents, buffers.moduli, buffers.results);
+
+    std::size_t primes = 0;
+
+    for (std::size_t k = 0; k < candidates.size(); k++)
+        if (state.is_prime[k] &&
+            !is_perfect_power(candidates[k], segment.max_sieving_prime))
+            candidates[primes++] = candidates[k];
+
+    return primes;
+}
+
+/// Sieve primes inside [start, stop], the primes of each
+/// segment are passed to sink(primes, size) in increasing
+/// order, see PrimeSinks.hpp.
+///
+template <typename T, typename Sink>
+uint64_t sieve_primes(SieveState& state,
+                      T start,
+                      T stop,
+                      bool verbose,
+                      Sink& sink)
+{
+    // CountSink does not need the primes
+    constexpr bool extract_primes = !std::is_same<Sink, const CountSink>::value &&
+                                    !std::is_same<Sink, CountSink>::value;
+    uint64_t count = 0;
+
+    if (start < 2)
+        start = 2;
+    if (start > stop)
+        return 0;
+    if (start <= 2)
+    {
+        const T two = 2;
+        count++;
+        sink(&two, 1);
+        start = 3;
+        if (start > stop)
+            return count;
+    }
+
+    SegmentedSieve<T> segmented_sieve(state, start, stop, verbose);
+    Vector<T>& candidates = state.buffers<T>().candidates;
+
+    while (!segmented_sieve.finished())
+    {
+        Segment segment = segmented_sieve.next(candidates, extract_primes);
+        std::size_t primes = segment.primes;
+
+        if (segment.p > 0)
+            primes = test_candidates(state, candidates, segment);
+
+        count += primes;
+
+        if (extract_primes && primes > 0)
+            sink(candidates.data(), primes);
+    }
+
+    return count;
+}
+
+template <typename T>
+uint64_t sieve_primes(T start,
+                      T stop,
+                      bool print_primes,
+                      bool verbose)
+{
+    SieveState state;
+
+    if (print_primes)
+    {
+        PrintSink sink;
+        return sieve_primes(state, start, stop, verbose, sink);
+    }
+    else
+    {
+        CountSink sink;
+        return sieve_primes(state, start, stop, verbose, sink);
+    }
+}
+
+/// Each thread of the thread pool keeps its own sieve
+/// state which is reused for all of its tasks.
+///
+SieveState& get_thread_state()
+{
+    thread_local SieveState state;
+    return state;
+}
+
+/// Thread placement of the thread pool, see set_affinity().
+/// The first pinned_threads threads of the pool have been
+/// placed using the pinned_affinity mode.
+///
+Affinity affinity = AFFINITY_NONE;
+Affinity pinned_affinity = AFFINITY_NONE;
+std::size_t pinned_threads = 0;
+std::mutex affinity_mutex;
+
+/// AFFINITY_CORES pins the threads to the allowed CPUs in
+/// order, AFFINITY_NUMA spreads the threads round-robin
+/// across the NUMA nodes. As each thread allocates its own
+/// SieveState, its buffers end up on its own NUMA node
+/// (first touch).
+///
+int get_cpu(const std::vector<std::vector<int>>& nodes, std::size_t i)
+{
+    if (affinity == AFFINITY_NUMA)
+    {
+        const std::vector<int>& cpus = nodes[i % nodes.size()];
+        return cpus[(i / nodes.size()) % cpus.size()];
+    }
+
+    std::vector<int> cpus;
+    for (const std::vector<int>& node_cpus : nodes)
+        cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+
+    return cpus[i % cpus.size()];
+}
+
+/// Returns the thread pool with at least the given
+/// number of threads, new threads are pinned to CPUs
+/// if requested using set_affinity(). If the mode has
+/// been changed all threads are placed again,
+/// AFFINITY_NONE unpins them.
+///
+ThreadPool& get_thread_pool(int threads)
+{
+    static ThreadPool pool;
+    pool.reserve(threads);
+
+    std::lock_guard<std::mutex> lock(affinity_mutex);
+
+    if (affinity == AFFINITY_NONE &&
+        pinned_affinity == AFFINITY_NONE)
+        return pool;
+
+    const std::vector<std::vector<int>>& nodes = get_numa_nodes();
+
+    if (nodes.empty())
+        return pool;
+
+    if (affinity != pinned_affinity)
+        pinned_threads = 0;
+
+    pool.for_each_thread([&](std::size_t i, std::thread& thread) {
+        if (i >= pinned_threads)
+        {
+            if (affinity == AFFINITY_NONE)
+                unpin_thread(thread);
+            else
+                pin_thread(thread, get_cpu(nodes, i));
+        }
+    });
+
+    pinned_affinity = affinity;
+    pinned_threads = pool.size();
+
+    return pool;
+}
+
+double get_min_thread_dist(double stop)
+{
+    const ProfileBand* band = get_profile_band(stop);
+
+    if (band)
+        return band->min_thread_dist;
+
+    double min_thread_dist = 1e4;
+    double root5_stop = std::pow(stop, 1.0 / 5.0);
+    min_thread_dist = std::max(min_thread_dist, root5_stop);
+    return min_thread_dist;
+}
+
+/// When generating primes each chunk's primes are buffered
+/// until they are passed to the sink, see sieve_primes_parallel().
+///
+template <typename T>
+double get_max_chunk_dist(const T& stop)
+{
+    return std::max(1e7, get_min_thread_dist((double) stop));
+}
+
+/// Use one thread per physical CPU core, see set_physical_cores()
+bool physical_cores = false;
+
+int get_max_threads()
+{
+    int max_threads = std::thread::hardware_concurrency();
+    return std::max(1, max_threads);
+}
+
+/// Default number of threads: inside a container
+/// hardware_concurrency() reports the host's CPUs, using
+/// more threads than the cgroup CPU quota gets the process
+/// throttled by the CFS scheduler.
+///
+int get_default_threads()
+{
+    int threads = get_max_threads();
+    int available_cpus = get_available_cpus();
+
+    if (available_cpus > 0)
+        threads = std::min(threads, available_cpus);
+
+    if (physical_cores)
+    {
+        int smt_threads = (int) get_l1_cache_sharing();
+        smt_threads = std::max(1, smt_threads);
+        threads = (threads + smt_threads - 1) / smt_threads;
+    }
+
+    return std::max(1, threads);
+}
+
+/// With a memory budget each thread may use at most 7/8 of
+/// max_memory / threads bytes, the remaining 1/8 is used by
+/// the thread's arena to cache freed blocks, see arena.cpp.
+/// When generating primes each thread's chunk of primes is
+/// buffered until it is passed to the sink.
+///
+template <typename T>
+uint64_t get_thread_memory(const T& stop,
+                           int threads,
+                           double chunk_dist,
+                           bool generate)
+{
+    double memory = (double) max_memory / threads;
+    memory -= memory / 8;
+
+    if (generate)
+        memory -= 2 * sizeof(T) * chunk_dist / std::log((double) stop);
+
+    return (uint64_t) std::max(1.0, memory);
+}
+
+/// Bytes of freed blocks cached by each thread's arena
+std::size_t get_max_cached(int threads)
+{
+    if (max_memory == 0)
+        return arena_default_max_cached;
+
+    uint64_t max_cached = max_memory / threads / 8;
+    return (std::size_t) std::min(max_cached, (uint64_t) arena_default_max_cached);
+}
+
+/// Using more threads is usually faster, but each thread then
+/// has a smaller memory budget which may require a smaller s
+/// (more prime bases to test) and delta. Returns the number
+/// of threads <= max_threads with the smallest estimated
+/// runtime that fits into max_memory.
+///
+template <typename T>
+int get_memory_threads(const T& start,
+                       const T& stop,
+                       int max_threads,
+                       bool generate)
+{
+    const Costs& costs = get_costs(stop);
+    int threads = 0;
+    double seconds = 0;
+
+    for (int t = 1; t <= max_threads; t++)
+    {
+        T thread_dist = (stop - start) / t + 1;
+        T high = start + (thread_dist - 1);
+        double chunk_dist = std::min((double) thread_dist, get_max_chunk_dist(stop));
+        uint64_t memory = get_thread_memory(stop, t, chunk_dist, generate);
+        Tuning tuning;
+
+        if (find_tuning(start, high, costs, memory, tuning) &&
+            (threads == 0 || tuning.total() < seconds))
+        {
+            threads = t;
+            seconds = tuning.total();
+        }
+    }
+
+    if (threads == 0)
+    {
+        double min_memory = get_min_memory(stop) * 8 / 7;
+        throw std::runtime_error("max-memory: requires at least " + to_mib(min_memory));
+    }
+
+    return threads;
+}
+
+template <typename T>
+int get_threads(const T& start, const T& stop, int threads, bool generate)
+{
+    if (threads > 0)
+        threads = std::min(threads, get_max_threads());
+    else
+    {
+        int max_threads = get_default_threads();
+        double min_thread_dist = get_min_thread_dist((double) stop);
+        double t = (double) (stop - start) / min_thread_dist;
+        t = std::min(t, (double) max_threads);
+        threads = (int) std::max(1.0, t);
+    }
+
+    if (max_memory > 0)
+        threads = get_memory_threads(start, stop, threads, generate);
+
+    return threads;
+}
+
+template <typename T>
+struct ChunkResult
+{
+    uint64_t count = 0;
+    Vector<T> primes;
+};
+
+/// Buffers the primes of a chunk
+template <typename T>
+struct ChunkSink
+{
+    Vector<T>& primes;
+
+    void operator()(const T* batch, std::size_t size) const
+    {
+        for (std::size_t i = 0; i < size; i++)
+            primes.push_back(batch[i]);
+    }
+};
+
+template <typename T>
+struct CandidateBatch
+{
+    uint64_t chunk = 0;
+    uint64_t id = 0;
+    Segment segment;
+    Vector<T> candidates;
+};
+
+template <typename T>
+struct PipelineState
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    // Next chunk to sieve
+    T low;
+    T stop;
+    T chunk_dist;
+    uint64_t next_chunk = 0;
+    // Next batch to pass to the sink
+    uint64_t sink_chunk = 0;
+    uint64_t sink_id = 0;
+    // At most max_chunks chunks after sink_chunk are
+    // sieved, this bounds the memory usage of results.
+    uint64_t max_chunks = 0;
+    std::size_t max_queue = 0;
+    uint64_t thread_memory = 0;
+    // Batches that need the Pseudosquares Prime Test
+    std::deque<CandidateBatch<T>> queue;
+    // Batches of primes waiting to be passed to the sink
+    std::map<std::pair<uint64_t, uint64_t>, CandidateBatch<T>> results;
+    std::vector<Vector<T>> free_buffers;
+    std::size_t sieving = 0;
+    std::size_t testing = 0;
+    uint64_t count = 0;
+    bool generate = false;
+    bool verbose = false;
+    std::exception_ptr error;
+
+    bool chunks_left() const
+    {
+        return low <= stop;
+    }
+
+    bool finished() const
+    {
+        return !chunks_left() && sieving == 0 && testing == 0 && queue.empty();
+    }
+
+    /// Requires a locked mutex
+    void add_primes(CandidateBatch<T>&& batch)
+    {
+        count += batch.segment.primes;
+        if (generate)
+            results.emplace(std::make_pair(batch.chunk, batch.id), std::move(batch));
+        else
+            free_buffers.push_back(std::move(batch.candidates));
+        cond.notify_all();
+    }
+};
+
+template <typename T>
+void pipeline_worker(PipelineState<T>& ps, bool prefer_sieving)
+{
+    SieveState& state = get_thread_state();
+    state.thread_memory = ps.thread_memory;
+    std::unique_ptr<SegmentedSieve<T>> segmented_sieve;
+    uint64_t chunk = 0;
+    uint64_t id = 0;
+    std::unique_lock<std::mutex> lock(ps.mutex);
+
+    try
+    {
+        while (!ps.error)
+        {
+            bool can_test = !ps.queue.empty();
+            bool can_sieve = ps.queue.size() < ps.max_queue &&
+                (segmented_sieve || (ps.chunks_left() &&
+                    (!ps.generate || ps.next_chunk < ps.sink_chunk + ps.max_chunks)));
+
+            if (can_test && (!prefer_sieving || !can_sieve))
+            {
+                CandidateBatch<T> batch = std::move(ps.queue.front());
+                ps.queue.pop_front();
+                ps.testing++;
+                ps.cond.notify_all();
+                lock.unlock();
+
+                batch.segment.primes = test_candidates(state, batch.candidates, batch.segment);
+                batch.segment.p = 0;
+
+                lock.lock();
+                ps.testing--;
+                ps.add_primes(std::move(batch));
+            }
+            else if (can_sieve && !segmented_sieve)
+            {
+                // Start sieving the next chunk
+                T low = ps.low;
+                T high = low + ps.chunk_dist - 1;
+                high = std::min(high, ps.stop);
+                chunk = ps.next_chunk++;
+                id = 0;
+                ps.low += ps.chunk_dist;
+                ps.sieving++;
+                bool verbose = ps.verbose && chunk == 0;
+                lock.unlock();
+                segmented_sieve.reset(new SegmentedSieve<T>(state, low, high, verbose));
+                lock.lock();
+            }
+            else if (can_sieve)
+            {
+                CandidateBatch<T> batch;
+                batch.chunk = chunk;
+                batch.id = id++;
+                if (!ps.free_buffers.empty())
+                {
+                    batch.candidates = std::move(ps.free_buffers.back());
+                    ps.free_buffers.pop_back();
+                }
+                lock.unlock();
+
+                batch.segment = segmented_sieve->next(batch.candidates, ps.generate);
+                if (batch.segment.is_last)
+                    segmented_sieve.reset();
+
+                lock.lock();
+                if (batch.segment.is_last)
+                    ps.sieving--;
+                if (batch.segment.p > 0)
+                {
+                    ps.queue.push_back(std::move(batch));
+                    ps.cond.notify_all();
+                }
+                else
+                    ps.add_primes(std::move(batch));
+            }
+            else if (ps.finished())
+                break;
+            else
+            {
+                TraceScope trace("queue wait");
+                ps.cond.wait(lock);
+            }
+        }
+    }
+    catch (...)
+    {
+        if (!lock.owns_lock())
+            lock.lock();
+        if (!ps.error)
+            ps.error = std::current_exception();
+    }
+
+    ps.cond.notify_all();
+}
+
+/// Sieve the primes inside [start, stop] with start >= 3 in
+/// pipeline mode, see pipeline_worker(). The calling thread
+/// passes the primes to the sink in increasing order.
+///
+template <typename T>
+uint64_t sieve_primes_pipeline(T start,
+                               T stop,
+                               T chunk_dist,
+                               int threads,
+                               uint64_t thread_memory,
+                               const CallbackSink<T>& sink,
+                               bool verbose)
+{
+    PipelineState<T> ps;
+    ps.low = start;
+    ps.stop = stop;
+    ps.chunk_dist = chunk_dist;
+    ps.thread_memory = thread_memory;
+    ps.max_chunks = threads;
+    ps.max_queue = 2 * (std::size_t) threads;
+    ps.generate = (bool) sink;
+    ps.verbose = verbose;
+
+    int sieve_threads = 0;
+    if (pipeline > 0)
+        sieve_threads = std::min(pipeline, threads);
+
+    ThreadPool& pool = get_thread_pool(threads);
+    std::vector<std::future<void>> futures;
+
+    for (int i = 0; i < threads; i++)
+    {
+        bool prefer_sieving = i < sieve_threads;
+        futures.emplace_back(pool.submit([&ps, prefer_sieving]() {
+            pipeline_worker(ps, prefer_sieving);
+        }));
+    }
+
+    std::unique_lock<std::mutex> lock(ps.mutex);
+
+    try
+    {
+        while (!ps.error)
+        {
+            auto iter = ps.results.find(std::make_pair(ps.sink_chunk, ps.sink_id));
+
+            if (iter != ps.results.end())
+            {
+                CandidateBatch<T> batch = std::move(iter->second);
+                ps.results.erase(iter);
+                ps.sink_id++;
+                if (batch.segment.is_last)
+                {
+                    ps.sink_chunk++;
+                    ps.sink_id = 0;
+                }
+                lock.unlock();
+
+                if (batch.segment.primes > 0)
+                {
+                    TraceScope trace("output");
+                    sink(batch.candidates.data(), batch.segment.primes);
+                }
+
+                lock.lock();
+                ps.free_buffers.push_back(std::move(batch.candidates));
+                ps.cond.notify_all();
+            }
+            else if (ps.finished())
+                break;
+            else
+            {
+                TraceScope trace("wait");
+                ps.cond.wait(lock);
+            }
+        }
+    }
+    catch (...)
+    {
+        if (!lock.owns_lock())
+            lock.lock();
+        if (!ps.error)
+            ps.error = std::current_exception();
+        ps.cond.notify_all();
+    }
+
+    lock.unlock();
+
+    for (auto& future : futures)
+        future.get();
+
+    if (ps.error)
+        std::rethrow_exception(ps.error);
+
+    return ps.count;
+}
+
+/// Sieve the primes inside [start, stop] in parallel using the
+/// thread pool. If a sink is provided the primes of each chunk
+/// are buffered and the calling thread passes them to the sink
+/// as one batch in increasing order. At most threads chunks
+/// are in flight, which bounds the memory usage.
+///
+template <typename T>
+uint64_t sieve_primes_parallel(T start,
+                               T stop,
+                               int threads,
+                               const CallbackSink<T>& sink,
+                               bool verbose)
+{
+    if (start < 2)
+        start = 2;
+    if (start > stop)
+        return 0;
+
+    bool generate = (bool) sink;
+    threads = get_threads(start, stop, threads, generate);
+    T thread_dist = (stop - start) / threads + 1;
+    T chunk_dist = thread_dist;
+
+    // Use smaller chunks when generating primes as each
+    // chunk's primes are buffered until they are passed
+    // to the sink.
+    if (generate)
+    {
+        double max_chunk_dist = get_max_chunk_dist(stop);
+        if ((double) chunk_dist > max_chunk_dist)
+            chunk_dist = (uint64_t) max_chunk_dist;
+    }
+
+    uint64_t thread_memory = 0;
+
+    if (max_memory > 0)
+    {
+        thread_memory = get_thread_memory(stop, threads, (double) chunk_dist, generate);
+        arena_set_max_cached(get_max_cached(threads));
+    }
+
+    if (verbose)
+    {
+        std::cout << "Thread dist: " << thread_dist << std::endl;
+        std::cout << "Threads: " << threads << std::endl;
+        if (max_memory > 0)
+            std::cout << "Max memory: " << to_mib((double) max_memory) << ", " << to_mib((double) thread_memory) << " per thread" << std::endl;
+        if (pipeline != PIPELINE_OFF)
+            std::cout << "Pipeline: " << ((pipeline > 0) ? std::to_string(pipeline) + " sieving threads" : "auto") << std::endl;
+        std::cout << std::endl;
+    }
+
+    if (pipeline != PIPELINE_OFF)
+    {
+        uint64_t count = 0;
+
+        if (start <= 2)
+        {
+            const T two = 2;
+            count++;
+            if (generate)
+                sink(&two, 1);
+            start = 3;
+            if (start > stop)
+                return count;
+        }
+
+        return count + sieve_primes_pipeline(start, stop, chunk_dist, threads, thread_memory, sink, verbose);
+    }
+
+    ThreadPool& pool = get_thread_pool(threads);
+    std::deque<std::future<ChunkResult<T>>> futures;
+    uint64_t count = 0;
+
+    auto finish_chunk = [&]() {
+        ChunkResult<T> res;
+        {
+            TraceScope trace("wait");
+            res = futures.front().get();
+        }
+        futures.pop_front();
+        count += res.count;
+        if (!res.primes.empty())
+        {
+            TraceScope trace("output");
+            sink(res.primes.data(), res.primes.size());
+        }
+    };
+
+    for (T low = start; low <= stop; low += chunk_dist)
+    {
+        T high = low + chunk_dist - 1;
+        high = std::min(high, stop);
+        bool chunk_verbose = verbose && low == start;
+
+        if (futures.size() >= (std::size_t) threads)
+            finish_chunk();
+
+        futures.emplace_back(pool.submit([=]() {
+            ChunkResult<T> res;
+            SieveState& state = get_thread_state();
+            state.thread_memory = thread_memory;
+            if (generate)
+            {
+                ChunkSink<T> sink{res.primes};
+                res.count = sieve_primes(state, low, high, chunk_verbose, sink);
+            }
+            else
+            {
+                CountSink sink;
+                res.count = sieve_primes(state, low, high, chunk_verbose, sink);
+            }
+            return res;
+        }));
+    }
+
+    while (!futures.empty())
+        finish_chunk();
+
+    return count;
+}
+
+/// Sieve the primes inside [start, stop] < 2^64 using
+/// libprimesieve which is much faster than the Pseudosquares
+/// Prime Sieve for small numbers.
+///
+template <typename T>
+uint64_t primesieve_sieve(uint64_t start,
+                          uint64_t stop,
+                          int threads,
+                          const CallbackSink<T>& sink)
+{
+    if (!sink)
+    {
+        // count_primes() is parallelized by libprimesieve
+        primesieve::set_num_threads((threads > 0) ? threads : get_default_threads());
+        return primesieve::count_primes(start, stop);
+    }
+
+    // Largest prime < 2^64, primesieve::iterator
+    // throws an exception if we go past it.
+    const uint64_t max_prime = 18446744073709551557ull;
+    primesieve::iterator it(start, stop);
+    Vector<T> primes;
+    uint64_t count = 0;
+
+    while (true)
+    {
+        it.generate_next_primes();
+        std::size_t size = it.size_;
+        primes.clear();
+
+        for (std::size_t i = 0; i < size && it.primes_[i] <= stop; i++)
+            primes.push_back(it.primes_[i]);
+
+        count += primes.size();
+        if (!primes.empty())
+            sink(primes.data(), primes.size());
+        if (primes.size() < size ||
+            it.primes_[size - 1] >= max_prime)
+            break;
+    }
+
+    return count;
+}
+
+/// Sieve the primes inside [start, stop] using the faster
+/// libprimesieve for the numbers < 2^64 and the Pseudosquares
+/// Prime Sieve for the numbers >= 2^64.
+///
+template <typename T>
+uint64_t sieve_primes_engine(T start,
+                             T stop,
+                             int threads,
+                             const CallbackSink<T>& sink,
+                             bool verbose,
+                             Engine engine)
+{
+    if (start < 2)
+        start = 2;
+    if (start > stop)
+        return 0;
+
+    const T max_stop = primesieve::get_max_stop();
+
+    if (engine == ENGINE_PRIMESIEVE && stop > max_stop)
+        throw std::runtime_error("primesieve engine requires stop < 2^64");
+    if (engine == ENGINE_PSEUDOSQUARES || start > max_stop)
+        return sieve_primes_parallel(start, stop, threads, sink, verbose);
+
+    T high = std::min(stop, max_stop);
+
+    if (verbose)
+    {
+        std::cout << "Engine: primesieve [" << start << ", " << high << "]" << std::endl;
+        if (stop > high)
+            std::cout << "Engine: pseudosquares [" << high + 1 << ", " << stop << "]" << std::endl;
+        std::cout << std::endl;
+    }
+
+    uint64_t count;
+    {
+        TraceScope trace("primesieve");
+        count = primesieve_sieve((uint64_t) start, (uint64_t) high, threads, sink);
+    }
+
+    if (stop > high)
+        count += sieve_primes_parallel(T(high + 1), stop, threads, sink, verbose);
+
+    return count;
+}
+
+void print_peak_memory()
+{
+    uint64_t bytes = get_peak_memory();
+    if (bytes > 0)
+        std::cout << "Peak memory: " << to_mib((double) bytes) << std::endl;
+}
+
+void check_stop(uint128_t stop)
+{
+    // Our Montgomery modular exponentiation requires
+    // n < 2^128 / 4. Our implementation is also limited by
+    // the formula n / s < max(Lp). Using the known
+    // pseudosquares up to max(Lp) = L_373 and s <= 2^32 - 1
+    // our implementation requires n < max(Lp) * (2^32 - 1)
+    // ~ 1.8 * 10^34, see find_tuning() and estimate().
+    if (stop > std::numeric_limits<uint128_t>::max() / 4)
+        throw std::runtime_error("stop must be < 2^126");
+}
+
+void check_stop(const uint256_t& stop)
+{
+    // Using the known pseudosquares our implementation
+    // requires n < max(Lp) * (2^32 - 1) ~ 1.8 * 10^34, see
+    // find_tuning() and estimate(). Above larger pseudosquares
+    // must be loaded using load_pseudosquares(). As the
+    // loaded Lp < 2^126 and s < 2^32, n / s < max(Lp)
+    // requires n < 2^158.
+    if (stop >= uint256_t(1) << 158)
+        throw std::runtime_error("stop must be < 2^158");
+}
+
+} // namespace
+
+// Load additional pseudosquares from a text file
+void load_pseudosquares(const std::string& filename)
+{
+    std::ifstream file(filename);
+
+    if (!file)
+        throw std::runtime_error("failed to open pseudosquares file: " + filename);
+
+    std::string line;
+
+    // Each line contains a prime p and its pseudosquare Lp,
+    // separated by whitespace. Lines starting with '#'
+    // are comments.
+    while (std::getline(file, line))
+    {
+        std::istringstream iss(line);
+        std::string p, Lp;
+
+        if (!(iss >> p) || p[0] == '#')
+            continue;
+        if (!(iss >> Lp))
+            throw std::runtime_error("pseudosquares: missing Lp for p = " + p);
+
+        add_pseudosquare(parse_uint128(p), parse_uint128(Lp));
+    }
+}
+
+// Thread placement of pseudosquares_prime_sieve_parallel()
+void set_affinity(Affinity mode)
+{
+    affinity = mode;
+    set_numa_replicas(mode == AFFINITY_NUMA);
+}
+
+// Default number of threads of pseudosquares_prime_sieve_parallel()
+void set_physical_cores(bool enabled)
+{
+    physical_cores = enabled;
+}
+
+// Pipeline mode of pseudosquares_prime_sieve_parallel()
+void set_pipeline(int sieve_threads)
+{
+    if (sieve_threads < PIPELINE_AUTO)
+        throw std::runtime_error("pipeline: invalid number of sieving threads");
+
+    pipeline = sieve_threads;
+}
+
+// Memory budget of pseudosquares_prime_sieve_parallel()
+void set_max_memory(uint64_t bytes)
+{
+    max_memory = bytes;
+    arena_set_max_cached(get_max_cached(1));
+}
+
+// Tuning parameters measured by --tune
+void set_host_profile(const std::vector<ProfileBand>& bands)
+{
+    for (const ProfileBand& band : bands)
+        if (band.sieve_size < 1024 ||
+            band.min_thread_dist < 1)
+            throw std::runtime_error("profile: invalid tuning parameters");
+
+    host_profile = bands;
+    std::sort(host_profile.begin(), host_profile.end(),
+        [](const ProfileBand& a, const ProfileBand& b) { return a.max_stop < b.max_stop; });
+}
+
+// Sieve primes inside [start, stop]
+uint64_t pseudosquares_prime_sieve(uint128_t start,
+                                   uint128_t stop,
+                                   bool print_primes,
+                                   bool verbose)
+{
+    check_stop(stop);
+    return sieve_primes(start, stop, print_primes, verbose);
+}
+
+// Sieve primes inside [start, stop] with stop < 2^158
+uint64_t pseudosquares_prime_sieve(const uint256_t& start,
+                                   const uint256_t& stop,
+                                   bool print_primes,
+                                   bool verbose)
+{
+    check_stop(stop);
+    return sieve_primes(start, stop, print_primes, verbose);
+}
+
+// Sieve primes inside [start, stop] using multiple threads,
+// primes < 2^64 are sieved using libprimesieve by default.
+uint64_t pseudosquares_prime_sieve_parallel(uint128_t start,
+                                            uint128_t stop,
+                                            int threads,
+                                            const CallbackSink<uint128_t>& sink,
+                                            bool verbose,
+                                            Engine engine)
+{
+    check_stop(stop);
+    uint64_t count = sieve_primes_engine(start, stop, threads, sink, verbose, engine);
+
+    if (verbose)
+        print_peak_memory();
+
+    return count;
+}
+
+// Sieve primes inside [start, stop] with stop < 2^158
+// using multiple threads.
+uint64_t pseudosquares_prime_sieve_parallel(const uint256_t& start,
+                                            const uint256_t& stop,
+                                            int threads,
+                                            const CallbackSink<uint256_t>& sink,
+                                            bool verbose,
+                                            Engine engine)
+{
+    check_stop(stop);
+    uint64_t count = sieve_primes_engine(start, stop, threads, sink, verbose, engine);
+
+    if (verbose)
+        print_peak_memory();
+
+    return count;
+}
+
+struct PseudosquaresSieve::Context
+{
+    SieveState state;
+};
+
+PseudosquaresSieve::PseudosquaresSieve()
+    : context_(new Context)
+{ }
+
+PseudosquaresSieve::~PseudosquaresSieve() = default;
+PseudosquaresSieve::PseudosquaresSieve(PseudosquaresSieve&&) noexcept = default;
+PseudosquaresSieve& PseudosquaresSieve::operator=(PseudosquaresSieve&&) noexcept = default;
+
+uint64_t PseudosquaresSieve::count(uint128_t start, uint128_t stop)
+{
+    check_stop(stop);
+    CountSink sink;
+    return sieve_primes(context_->state, start, stop, false, sink);
+}
+
+uint64_t PseudosquaresSieve::count(const uint256_t& start, const uint256_t& stop)
+{
+    check_stop(stop);
+    CountSink sink;
+    return sieve_primes(context_->state, start, stop, false, sink);
+}
+
+uint64_t PseudosquaresSieve::generate(uint128_t start,
+                                      uint128_t stop,
+                                      const std::function<void(uint128_t)>& callback)
+{
+    check_stop(stop);
+    auto sink = [&](const uint128_t* primes, std::size_t size) {
+        for (std::size_t i = 0; i < size; i++)
+            callback(primes[i]);
+    };
+    return sieve_primes(context_->state, start, stop, false, sink);
+}
+
+uint64_t PseudosquaresSieve::generate(const uint256_t& start,
+                                      const uint256_t& stop,
+                                      const std::function<void(const uint256_t&)>& callback)
+{
+    check_stop(stop);
+    auto sink = [&](const uint256_t* primes, std::size_t size) {
+        for (std::size_t i = 0; i < size; i++)
+            callback(primes[i]);
+    };
+    return sieve_primes(context_->state, start, stop, false, sink);
+}
+
+uint64_t PseudosquaresSieve::generate(uint128_t start,
+                                      uint128_t stop,
+                                      std::vector<uint128_t>& primes)
+{
+    check_stop(stop);
+    VectorSink<uint128_t> sink{primes};
+    return sieve_primes(context_->state, start, stop, false, sink);
+}
+
+uint64_t PseudosquaresSieve::generate(const uint256_t& start,
+                                      const uint256_t& stop,
+                                      std::vector<uint256_t>& primes)
+{
+    check_stop(stop);
+    VectorSink<uint256_t> sink{primes};
+    return sieve_primes(context_->state, start, stop, false, sink);
+}
+
+uint64_t PseudosquaresSieve::generate_batches(uint128_t start,
+                                              uint128_t stop,
+                                              const CallbackSink<uint128_t>& sink)
+{
+    check_stop(stop);
+    return sieve_primes(context_->state, start, stop, false, sink);
+}
+
+uint64_t PseudosquaresSieve::generate_batches(const uint256_t& start,
+                                              const uint256_t& stop,
+                                              const CallbackSink<uint256_t>& sink)
+{
+    check_stop(stop);
+    return sieve_primes(context_->state, start, stop, false, sink);
 }
@@ -17,7 +17,26 @@
 #define PSEUDOSQUARES_PRIME_SIEVE_HPP
 
 #include "int128_t.hpp"
+#include "PrimeSinks.hpp"
+#include "uint256_t.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <stdint.h>
+#include <string>
+#include <vector>
+
+// Load additional pseudosquares from a text file.
+// Each line contains a prime p and its pseudosquare Lp.
+// Must be called before sieving.
+void load_pseudosquares(const std::string& filename);
+
+// Memory map a cache file of sieving primes, the file
+// is created with the sieving primes <= limit if it does
+// not exist yet. Must be called before sieving.
+void load_sieving_primes(const std::string& filename,
+                         uint64_t limit = 4294967295ull);
 
 // Sieve primes inside [start, stop]
 uint64_t pseudosquares_prime_sieve(uint128_t start,
@@ -25,4 +44,164 @@ uint64_t pseudosquares_prime_sieve(uint128_t start,
                                    bool print_primes = false,
                                    bool verbose = false);
 
+// Sieve primes inside [start, stop] with stop < 2^158.
+// For stop >= L_373 * (2^32 - 1) ~ 1.8 * 10^34 additional
+// pseudosquares must be loaded using load_pseudosquares(),
+// n / s < max(Lp) with Lp < 2^126 and s < 2^32.
+uint64_t pseudosquares_prime_sieve(const uint256_t& start,
+                                   const uint256_t& stop,
+                                   bool print_primes = false,
+                                   bool verbose = false);
+
+/// Engine used by pseudosquares_prime_sieve_parallel()
+enum Engine
+{
+    // libprimesieve for the numbers < 2^64 (which is much
+    // faster), Pseudosquares Prime Sieve for the numbers >= 2^64.
+    ENGINE_AUTO,
+    // Requires stop < 2^64
+    ENGINE_PRIMESIEVE,
+    ENGINE_PSEUDOSQUARES
+};
+
+/// Thread placement of pseudosquares_prime_sieve_parallel()
+enum Affinity
+{
+    AFFINITY_NONE,
+    // Pin each thread to its own CPU
+    AFFINITY_CORES,
+    // Pin the threads round-robin to the NUMA nodes and
+    // copy the sieving primes cache file to each node
+    AFFINITY_NUMA
+};
+
+// Pin the threads to CPUs (Linux only), the buffers of
+// each thread are then allocated on its own NUMA node.
+// Must be called before sieving.
+void set_affinity(Affinity mode);
+
+// Using threads = 0 pseudosquares_prime_sieve_parallel()
+// uses one thread per physical CPU core instead of one
+// thread per logical CPU core. The multiplications of the
+// Pseudosquares Prime Test hardly benefit from SMT.
+// Must be called before sieving.
+void set_physical_cores(bool enabled);
+
+enum
+{
+    PIPELINE_OFF = 0,
+    PIPELINE_AUTO = -1
+};
+
+// Pipeline mode of pseudosquares_prime_sieve_parallel():
+// the candidates of each segment are put into a bounded
+// queue from which they are tested by the next free thread.
+// sieve_threads > 0 threads prefer sieving and the other
+// threads prefer the Pseudosquares Prime Test. Using
+// PIPELINE_AUTO all threads balance sieving and testing.
+// Default: PIPELINE_OFF. Must be called before sieving.
+void set_pipeline(int sieve_threads);
+
+// Memory budget in bytes of pseudosquares_prime_sieve_parallel()
+// for all threads, 0 = unlimited (default). The number of
+// threads, the segment size delta and the sieving limit s
+// are chosen to fit into the budget, throws if even a
+// single thread does not fit. The memory used by
+// libprimesieve (primes < 2^64) is not included.
+// Must be called before sieving.
+void set_max_memory(uint64_t bytes);
+
+/// Tuning parameters of the numbers <= max_stop,
+/// measured on the current host by --tune.
+///
+struct ProfileBand
+{
+    double max_stop;
+    // Minimum sieve array size in bytes (default 256 KiB)
+    uint64_t sieve_size;
+    // Minimum interval size per thread
+    double min_thread_dist;
+    // Use the AVX512 IFMA modpow kernel if supported
+    bool avx512_ifma;
+};
+
+// Sieving up to stop uses the band with the smallest max_stop
+// >= stop (or the last band). An empty vector restores the
+// default heuristics. Must be called before sieving.
+void set_host_profile(const std::vector<ProfileBand>& bands);
+
+// Sieve primes inside [start, stop] using a thread pool which
+// is reused across calls, threads = 0 uses all CPU cores that
+// are available to this process (CPU affinity mask and cgroup
+// CPU quota). If a sink is provided it is called from the
+// calling thread with batches of primes in increasing order.
+// Returns the number of primes.
+uint64_t pseudosquares_prime_sieve_parallel(uint128_t start,
+                                            uint128_t stop,
+                                            int threads = 0,
+                                            const CallbackSink<uint128_t>& sink = nullptr,
+                                            bool verbose = false,
+                                            Engine engine = ENGINE_AUTO);
+
+// Same as above with stop < 2^158
+uint64_t pseudosquares_prime_sieve_parallel(const uint256_t& start,
+                                            const uint256_t& stop,
+                                            int threads = 0,
+                                            const CallbackSink<uint256_t>& sink = nullptr,
+                                            bool verbose = false,
+                                            Engine engine = ENGINE_AUTO);
+
+/// Sieve context for many queries, e.g. counting the primes
+/// inside many small intervals. The sieve array, the sieving
+/// primes and the buffers of the Pseudosquares Prime Test
+/// are kept between queries, they only grow if a query needs
+/// a larger s. Not thread-safe, use one PseudosquaresSieve
+/// per thread.
+///
+class PseudosquaresSieve
+{
+public:
+    PseudosquaresSieve();
+    ~PseudosquaresSieve();
+    PseudosquaresSieve(PseudosquaresSieve&&) noexcept;
+    PseudosquaresSieve& operator=(PseudosquaresSieve&&) noexcept;
+
+    // Count the primes inside [start, stop]
+    uint64_t count(uint128_t start, uint128_t stop);
+    uint64_t count(const uint256_t& start, const uint256_t& stop);
+
+    // Call callback(prime) for each prime inside [start, stop]
+    // in increasing order, returns the number of primes.
+    uint64_t generate(uint128_t start,
+                      uint128_t stop,
+                      const std::function<void(uint128_t)>& callback);
+
+    uint64_t generate(const uint256_t& start,
+                      const uint256_t& stop,
+                      const std::function<void(const uint256_t&)>& callback);
+
+    // Append the primes inside [start, stop] to primes
+    uint64_t generate(uint128_t start,
+                      uint128_t stop,
+                      std::vector<uint128_t>& primes);
+
+    uint64_t generate(const uint256_t& start,
+                      const uint256_t& stop,
+                      std::vector<uint256_t>& primes);
+
+    // Call sink(primes, size) with the primes of each segment
+    // in increasing order, returns the number of primes.
+    uint64_t generate_batches(uint128_t start,
+                              uint128_t stop,
+                              const CallbackSink<uint128_t>& sink);
+
+    uint64_t generate_batches(const uint256_t& start,
+                              const uint256_t& stop,
+                              const CallbackSink<uint256_t>& sink);
+
+private:
+    struct Context;
+    std::unique_ptr<Context> context_;
+};
+
 #endif
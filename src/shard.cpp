@@ -0,0 +1,261 @@
+///
+/// @file  shard.cpp
+/// @brief The interval [range_start, range_stop] is split into
+///        shards of nearly the same size. As the shard boundaries
+///        are computed from the interval and the number of shards
+///        only, each process or machine can compute its own shard
+///        and the shards never overlap. --merge checks that the
+///        records of all shards are present and that their
+///        intervals are contiguous before adding up the counts.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#include "shard.hpp"
+#include "calculator.hpp"
+#include "uint256_t.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iomanip>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint64_t shard_alignment = 1 << 20;
+
+/// First number of the shard index
+uint256_t get_shard_low(const uint256_t& range_start,
+                        const uint256_t& range_stop,
+                        uint64_t index,
+                        uint64_t shards)
+{
+    if (index == 0)
+        return range_start;
+    if (index == shards)
+        return range_stop + 1;
+
+    // range_start + dist * index / shards, without
+    // risking an overflow of dist * index.
+    uint256_t dist = range_stop - range_start + 1;
+    uint256_t q = dist / shards;
+    uint256_t r = dist % shards;
+    uint256_t low = range_start + q * index + std::min(r, uint256_t(index));
+    low -= low % shard_alignment;
+
+    return std::max(low, range_start);
+}
+
+template <typename T>
+T parse_value(const std::string& key, const std::string& value)
+{
+    try {
+        return calculator::eval<T>(value);
+    }
+    catch (const std::exception&) {
+        throw std::runtime_error("merge: invalid " + key + " = '" + value + "'");
+    }
+}
+
+} // namespace
+
+ShardResult get_shard(const uint256_t& range_start,
+                      const uint256_t& range_stop,
+                      uint64_t index,
+                      uint64_t shards)
+{
+    if (shards == 0 || index >= shards)
+        throw std::runtime_error("shard: requires 0 <= i < N for --shard=i/N");
+    if (range_start > range_stop)
+        throw std::runtime_error("shard: requires START <= STOP");
+
+    ShardResult shard;
+    shard.index = index;
+    shard.shards = shards;
+    shard.range_start = range_start;
+    shard.range_stop = range_stop;
+    uint256_t low = get_shard_low(range_start, range_stop, index, shards);
+    uint256_t next_low = get_shard_low(range_start, range_stop, index + 1, shards);
+
+    // Small intervals have fewer aligned boundaries than
+    // shards, next_low - 1 would wrap around if low = 0.
+    if (next_low > low)
+    {
+        shard.start = low;
+        shard.stop = next_low - 1;
+    }
+    else
+    {
+        shard.start = range_stop + 1;
+        shard.stop = range_stop;
+    }
+
+    return shard;
+}
+
+void parse_shard(const std::string& str, uint64_t& index, uint64_t& shards)
+{
+    std::size_t pos = str.find('/');
+
+    try {
+        if (pos == std::string::npos)
+            throw std::runtime_error("");
+
+        index = calculator::eval<uint64_t>(str.substr(0, pos));
+        shards = calculator::eval<uint64_t>(str.substr(pos + 1));
+    }
+    catch (const std::exception&) {
+        throw std::runtime_error("invalid option '--shard=" + str + "', expected --shard=i/N");
+    }
+
+    if (shards == 0 || index >= shards)
+        throw std::runtime_error("invalid option '--shard=" + str + "', requires 0 <= i < N");
+}
+
+std::string to_string(const ShardResult& shard)
+{
+    std::ostringstream oss;
+
+    oss << "shard=" << shard.index << "/" << shard.shards
+        << " range_start=" << shard.range_start
+        << " range_stop=" << shard.range_stop
+        << " start=" << shard.start
+        << " stop=" << shard.stop
+        << " primes=" << shard.primes
+        << " sum=" << shard.sum
+        << " hash=" << shard.hash
+        << " seconds=" << std::fixed << std::setprecision(3) << shard.seconds;
+
+    return oss.str();
+}
+
+std::vector<ShardResult> read_shards(std::istream& input)
+{
+    std::vector<ShardResult> shards;
+    std::string line;
+
+    while (std::getline(input, line))
+    {
+        if (line.compare(0, 6, "shard=") != 0)
+            continue;
+
+        std::istringstream iss(line);
+        std::string field;
+        ShardResult shard;
+        int fields = 0;
+
+        while (iss >> field)
+        {
+            std::size_t pos = field.find('=');
+            if (pos == std::string::npos)
+                throw std::runtime_error("merge: invalid record '" + line + "'");
+
+            std::string key = field.substr(0, pos);
+            std::string value = field.substr(pos + 1);
+            fields++;
+
+            if (key == "shard")
+            {
+                std::size_t slash = value.find('/');
+                if (slash == std::string::npos)
+                    throw std::runtime_error("merge: invalid shard = '" + value + "'");
+                shard.index = parse_value<uint64_t>(key, value.substr(0, slash));
+                shard.shards = parse_value<uint64_t>(key, value.substr(slash + 1));
+            }
+            else if (key == "range_start") shard.range_start = parse_value<uint256_t>(key, value);
+            else if (key == "range_stop") shard.range_stop = parse_value<uint256_t>(key, value);
+            else if (key == "start") shard.start = parse_value<uint256_t>(key, value);
+            else if (key == "stop") shard.stop = parse_value<uint256_t>(key, value);
+            else if (key == "primes") shard.primes = parse_value<uint64_t>(key, value);
+            else if (key == "sum") shard.sum = parse_value<uint64_t>(key, value);
+            else if (key == "hash") shard.hash = parse_value<uint64_t>(key, value);
+            else if (key == "seconds")
+            {
+                try { shard.seconds = std::stod(value); }
+                catch (const std::exception&) { throw std::runtime_error("merge: invalid seconds = '" + value + "'"); }
+            }
+            else
+                fields--;
+        }
+
+        if (fields != 9)
+            throw std::runtime_error("merge: incomplete record '" + line + "'");
+
+        shards.push_back(shard);
+    }
+
+    return shards;
+}
+
+ShardResult merge_shards(std::vector<ShardResult> shards)
+{
+    if (shards.empty())
+        throw std::runtime_error("merge: no shard records found");
+
+    const ShardResult& first = shards.front();
+
+    for (const ShardResult& shard : shards)
+        if (shard.shards != first.shards ||
+            shard.range_start != first.range_start ||
+            shard.range_stop != first.range_stop)
+            throw std::runtime_error("merge: the records belong to different shardings");
+
+    std::sort(shards.begin(), shards.end(),
+        [](const ShardResult& a, const ShardResult& b) { return a.index < b.index; });
+
+    ShardResult merged;
+    merged.range_start = first.range_start;
+    merged.range_stop = first.range_stop;
+    merged.start = first.range_start;
+    merged.stop = first.range_stop;
+    uint256_t next = first.range_start;
+
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        const ShardResult& shard = shards[i];
+
+        if (i > 0 && shard.index == shards[i - 1].index)
+            throw std::runtime_error("merge: duplicate shard " + std::to_string(shard.index));
+        if (shard.index != i)
+            throw std::runtime_error("merge: missing shard " + std::to_string(i) +
+                                     "/" + std::to_string(first.shards));
+        if (shard.start > shard.stop)
+        {
+            if (shard.start != first.range_stop + 1 ||
+                shard.stop != first.range_stop ||
+                shard.primes != 0)
+                throw std::runtime_error("merge: invalid empty shard " + std::to_string(shard.index));
+        }
+        else
+        {
+            if (shard.start != next)
+                throw std::runtime_error("merge: shard " + std::to_string(shard.index) +
+                                         " does not start at " + to_string(next));
+            if (shard.stop > first.range_stop)
+                throw std::runtime_error("merge: shard " + std::to_string(shard.index) +
+                                         " ends after " + to_string(first.range_stop));
+            next = shard.stop + 1;
+        }
+
+        merged.primes += shard.primes;
+        merged.sum += shard.sum;
+        merged.hash ^= shard.hash;
+        merged.seconds += shard.seconds;
+    }
+
+    if (shards.size() != first.shards)
+        throw std::runtime_error("merge: missing shard " + std::to_string(shards.size()) +
+                                 "/" + std::to_string(first.shards));
+    if (next != first.range_stop + 1)
+        throw std::runtime_error("merge: the shards do not cover the interval");
+
+    return merged;
+}
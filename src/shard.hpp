@@ -0,0 +1,98 @@
+///
+/// @file  shard.hpp
+/// @brief Split a huge interval into N shards that are sieved by
+///        different processes or machines. Each shard prints a
+///        one line result record which can be merged by
+///        pseudosquares_prime_sieve --merge.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include "uint256_t.hpp"
+
+#include <cstddef>
+#include <istream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// Result record of the shard index/shards of the
+/// interval [range_start, range_stop]. The shard covers
+/// [start, stop], empty shards have start = range_stop + 1
+/// and stop = range_stop.
+///
+struct ShardResult
+{
+    uint64_t index = 0;
+    uint64_t shards = 1;
+    uint256_t range_start = 0;
+    uint256_t range_stop = 0;
+    uint256_t start = 0;
+    uint256_t stop = 0;
+    uint64_t primes = 0;
+    // Order independent digests of the primes,
+    // the sum and the xor of hash(prime) mod 2^64.
+    uint64_t sum = 0;
+    uint64_t hash = 0;
+    double seconds = 0;
+
+    template <typename T>
+    void add_digest(const T* primes, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++)
+        {
+            uint64_t p = (uint64_t) primes[i];
+            sum += p;
+            hash ^= hash64(p);
+        }
+    }
+
+    /// splitmix64 finalizer
+    static uint64_t hash64(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+};
+
+/// Returns the shard index/shards of [range_start, range_stop].
+/// The shard boundaries only depend on the interval and the
+/// number of shards (not on the CPU), they are multiples of
+/// 2^20 (except for range_start and range_stop + 1).
+///
+ShardResult get_shard(const uint256_t& range_start,
+                      const uint256_t& range_stop,
+                      uint64_t index,
+                      uint64_t shards);
+
+/// Parse "i/N" of the --shard=i/N option
+void parse_shard(const std::string& str, uint64_t& index, uint64_t& shards);
+
+/// One line result record, e.g.:
+/// shard=1/4 range_start=0 range_stop=... start=... stop=...
+/// primes=... sum=... hash=... seconds=...
+///
+std::string to_string(const ShardResult& shard);
+
+/// Read all result records of the input stream, other
+/// lines (e.g. the program's regular output) are skipped.
+///
+std::vector<ShardResult> read_shards(std::istream& input);
+
+/// Check that all shards of the same interval are present
+/// exactly once and combine them into one record with
+/// shard=0/1 covering the whole interval.
+///
+ShardResult merge_shards(std::vector<ShardResult> shards);
+
+#endif
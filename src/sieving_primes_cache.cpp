@@ -0,0 +1,283 @@
+///
+/// @file  sieving_primes_cache.cpp
+/// @brief For short intervals near 10^30 generating the sieving
+///        primes <= s may take as long as sieving. Hence the
+///        sieving primes can be stored in a cache file that is
+///        created once and then memory mapped read-only. All
+///        threads share the same mapping and the operating
+///        system's page cache shares the file between processes.
+///
+///        File format (native byte order):
+///        char magic[8] = "PSSGAPS1";
+///        uint64_t limit; // Contains all sieving primes <= limit
+///        uint64_t size;  // Number of sieving primes
+///        uint8_t gaps[size]; // (prime - previous prime) / 2
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#include "sieving_primes_cache.hpp"
+#include "cpu_topology.hpp"
+#include "pseudosquares_prime_sieve.hpp"
+#include "Vector.hpp"
+
+#include <primesieve.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace {
+
+struct Header
+{
+    char magic[8];
+    uint64_t limit;
+    uint64_t size;
+};
+
+const char magic[8] = { 'P', 'S', 'S', 'G', 'A', 'P', 'S', '1' };
+
+/// Read-only memory mapping of a file
+class MappedFile
+{
+public:
+    MappedFile(const std::string& filename)
+    {
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("failed to open sieving primes file: " + filename);
+
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping)
+            {
+                data_ = (const uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                size_ = (std::size_t) size.QuadPart;
+                CloseHandle(mapping);
+            }
+        }
+
+        CloseHandle(file);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw std::runtime_error("failed to open sieving primes file: " + filename);
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* data = mmap(nullptr, (std::size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                data_ = (const uint8_t*) data;
+                size_ = (std::size_t) st.st_size;
+            }
+        }
+
+        close(fd);
+#endif
+        if (!data_)
+            throw std::runtime_error("failed to memory map sieving primes file: " + filename);
+    }
+
+    ~MappedFile()
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile(data_);
+#else
+        munmap((void*) data_, size_);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const
+    {
+        return data_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+std::unique_ptr<MappedFile> mapped_file;
+SievingPrimesCache cache;
+
+/// Copy of the cache file for a NUMA node
+struct Replica
+{
+    Vector<uint8_t> gaps;
+    SievingPrimesCache cache;
+};
+
+bool numa_replicas = false;
+std::map<int, Replica> replicas;
+std::mutex replicas_mutex;
+std::atomic<uint64_t> last_generation(0);
+
+/// Each process writes its own temporary file
+uint64_t get_process_id()
+{
+#if defined(_WIN32)
+    return (uint64_t) GetCurrentProcessId();
+#else
+    return (uint64_t) getpid();
+#endif
+}
+
+/// Write the sieving primes <= limit to a temporary
+/// file (unique per process) which is then renamed to
+/// filename. Hence other processes never see a partially
+/// written file, even if several processes create the
+/// same cache file concurrently.
+///
+void create_cache_file(const std::string& filename, uint64_t limit)
+{
+    std::string tmp_filename = filename + "." + std::to_string(get_process_id()) + ".tmp";
+    std::ofstream file(tmp_filename, std::ios::binary);
+
+    if (!file)
+        throw std::runtime_error("failed to create sieving primes file: " + filename);
+
+    // The header is written again once we know the size
+    Header header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.limit = limit;
+    header.size = 0;
+    file.write((const char*) &header, sizeof(header));
+
+    Vector<uint8_t> buffer;
+    buffer.reserve(1 << 20);
+    primesieve::iterator it(3, limit);
+    uint64_t last_prime = 1;
+    uint64_t prime;
+
+    while ((prime = it.next_prime()) <= limit)
+    {
+        // The maximum prime gap below 2^32 is 336
+        buffer.push_back((uint8_t) ((prime - last_prime) / 2));
+        last_prime = prime;
+        header.size++;
+
+        if (buffer.size() == buffer.capacity())
+        {
+            file.write((const char*) buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    file.write((const char*) buffer.data(), buffer.size());
+    file.seekp(0);
+    file.write((const char*) &header, sizeof(header));
+    file.close();
+
+    if (!file)
+    {
+        std::remove(tmp_filename.c_str());
+        throw std::runtime_error("failed to write sieving primes file: " + filename);
+    }
+
+    // On POSIX rename() atomically replaces a file that
+    // another process has created in the meantime (with the
+    // same content). On Windows rename() fails if the file
+    // exists, we then use the other process's file.
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+        std::remove(tmp_filename.c_str());
+}
+
+} // namespace
+
+const SievingPrimesCache& get_sieving_primes_cache()
+{
+    if (!numa_replicas ||
+        cache.size == 0 ||
+        get_numa_nodes().size() <= 1)
+        return cache;
+
+    int node = get_current_numa_node();
+    std::lock_guard<std::mutex> lock(replicas_mutex);
+    auto iter = replicas.find(node);
+
+    if (iter == replicas.end())
+    {
+        Replica& replica = replicas[node];
+        replica.gaps.resize(cache.size);
+        std::copy_n(cache.gaps, cache.size, replica.gaps.data());
+        replica.cache = cache;
+        replica.cache.gaps = replica.gaps.data();
+        replica.cache.generation = ++last_generation;
+        return replica.cache;
+    }
+
+    return iter->second.cache;
+}
+
+void set_numa_replicas(bool enable)
+{
+    numa_replicas = enable;
+}
+
+// Memory map a cache file of sieving primes
+void load_sieving_primes(const std::string& filename, uint64_t limit)
+{
+    if (limit > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("sieving primes: limit must be < 2^32");
+
+    if (!std::ifstream(filename))
+        create_cache_file(filename, limit);
+
+    std::unique_ptr<MappedFile> file(new MappedFile(filename));
+    Header header;
+
+    if (file->size() < sizeof(header))
+        throw std::runtime_error("invalid sieving primes file: " + filename);
+
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+        header.limit > std::numeric_limits<uint32_t>::max() ||
+        header.size != file->size() - sizeof(header))
+        throw std::runtime_error("invalid sieving primes file: " + filename);
+
+    cache.gaps = file->data() + sizeof(header);
+    cache.size = (std::size_t) header.size;
+    cache.limit = header.limit;
+    cache.generation = ++last_generation;
+    mapped_file = std::move(file);
+
+    std::lock_guard<std::mutex> lock(replicas_mutex);
+    replicas.clear();
+}
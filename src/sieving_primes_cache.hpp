@@ -0,0 +1,44 @@
+///
+/// @file  sieving_primes_cache.hpp
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef SIEVING_PRIMES_CACHE_HPP
+#define SIEVING_PRIMES_CACHE_HPP
+
+#include <cstddef>
+#include <stdint.h>
+
+/// Sieving primes from a memory mapped cache file. The primes
+/// are stored as (prime - previous prime) / 2 in uint8_t, the
+/// first prime 3 is stored as 1, same as in SievingPrimes.
+///
+struct SievingPrimesCache
+{
+    const uint8_t* gaps = nullptr;
+    // Number of sieving primes
+    std::size_t size = 0;
+    // Contains all sieving primes <= limit
+    uint64_t limit = 0;
+    // Unique for each loaded cache file and each NUMA
+    // node replica, 0 if no cache file has been loaded.
+    uint64_t generation = 0;
+};
+
+/// Returns an empty cache (limit = 0) if no
+/// cache file has been loaded.
+///
+const SievingPrimesCache& get_sieving_primes_cache();
+
+/// If enabled, get_sieving_primes_cache() returns a copy of
+/// the cache file that is local to the NUMA node of the
+/// calling thread. The copy is created by the first thread
+/// of each node, hence its memory is allocated on that node.
+///
+void set_numa_replicas(bool enable);
+
+#endif
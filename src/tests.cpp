@@ -1,10 +1,29 @@
 #include "pseudosquares_prime_sieve.hpp"
+#include "arena.hpp"
+#include "cpu_topology.hpp"
+#include "host_profile.hpp"
+#include "modpow.hpp"
+#include "perf_counters.hpp"
+#include "shard.hpp"
+#include "trace.hpp"
+#include "MontgomeryWide.hpp"
+#include "uint256_t.hpp"
 
 #include <array>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <stdexcept>
 #include <stdint.h>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+  #include <sys/stat.h>
+#endif
 
 /// Correct pi(x) values to compare with test results
 const std::array<uint64_t, 8> pix =
@@ -56,6 +75,24 @@ void check(bool OK)
     std::exit(1);
 }
 
+/// Returns true if load_pseudosquares() accepts the file
+bool load_pseudosquares_file(const std::string& content)
+{
+  const char* filename = "pseudosquares_test.txt";
+  std::ofstream(filename) << content;
+  bool OK = true;
+
+  try {
+    load_pseudosquares(filename);
+  }
+  catch (const std::exception&) {
+    OK = false;
+  }
+
+  std::remove(filename);
+  return OK;
+}
+
 int main()
 {
   std::cout << std::left;
@@ -88,6 +125,551 @@ int main()
     j++;
   }
 
+  std::cout << std::endl;
+
+  // Same as above but using the uint256_t implementation
+  {
+    uint256_t start = uint256_t(10000000000000000000ull) * 1000000;
+    uint256_t stop = start + 1000000;
+    uint64_t count = pseudosquares_prime_sieve(start, stop);
+    std::cout << "PrimePi(10^25, 10^25+10^6) = " << std::setw(7) << count;
+    check(count == pix_2[15]);
+  }
+
+  std::cout << std::endl;
+
+  // Reuse the same PseudosquaresSieve for many queries,
+  // in decreasing order the sieving primes shrink.
+  {
+    PseudosquaresSieve sieve;
+    std::vector<uint128_t> starts;
+    uint128_t start = (uint128_t) 1e10;
+
+    for (std::size_t i = 0; i < pix_2.size(); i++, start *= 10)
+      starts.push_back(start);
+
+    for (std::size_t i : { 23, 12, 0, 5, 20, 1 })
+    {
+      uint64_t count = sieve.count(starts[i], starts[i] + (uint64_t) 1e6);
+      std::cout << "PseudosquaresSieve::count(10^" << i + 10 << ", 10^" << i + 10 << "+10^6) = " << std::setw(7) << count;
+      check(count == pix_2[i]);
+    }
+
+    uint256_t start256 = uint256_t(starts[15]);
+    uint64_t count = sieve.count(start256, start256 + 1000000);
+    std::cout << "PseudosquaresSieve::count(10^25, 10^25+10^6) = " << std::setw(7) << count;
+    check(count == pix_2[15]);
+
+    // The primes are generated in increasing order
+    uint128_t prev = 0;
+    uint64_t primes = 0;
+    bool OK = true;
+    count = sieve.generate(starts[8], starts[8] + (uint64_t) 1e6,
+                           [&](uint128_t prime) { OK &= (prime > prev); prev = prime; primes++; });
+    std::cout << "PseudosquaresSieve::generate(10^18, 10^18+10^6) = " << std::setw(7) << count;
+    check(OK && count == primes && count == pix_2[8]);
+
+    std::vector<uint128_t> vect;
+    count = sieve.generate(starts[8], starts[8] + (uint64_t) 1e6, vect);
+    std::cout << "PseudosquaresSieve::generate(10^18, 10^18+10^6, vector) = " << std::setw(7) << count;
+    check(count == vect.size() && count == pix_2[8] && vect.back() == prev);
+
+    std::size_t batches = 0;
+    primes = 0;
+    count = sieve.generate_batches(1, 10000000, [&](const uint128_t*, std::size_t size) { batches++; primes += size; });
+    std::cout << "PseudosquaresSieve::generate_batches(1, 10^7) = " << std::setw(7) << count;
+    check(batches > 1 && count == primes && count == pix[6]);
+
+    count = sieve.count(1, 100000000);
+    std::cout << "PseudosquaresSieve::count(1, 10^8) = " << std::setw(7) << count;
+    check(count == pix[7]);
+  }
+
+  std::cout << std::endl;
+
+  // The thread pool is reused across calls
+  for (int threads : { 1, 3, 4 })
+  {
+    uint128_t start = (uint128_t) 1e12;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, threads, nullptr, false, ENGINE_PSEUDOSQUARES);
+    std::cout << "pseudosquares_prime_sieve_parallel(10^12, 10^12+10^6, " << threads << " threads) = " << std::setw(7) << count;
+    check(count == pix_2[2]);
+  }
+
+  // Primes < 2^64 are sieved using libprimesieve
+  for (Engine engine : { ENGINE_AUTO, ENGINE_PRIMESIEVE, ENGINE_PSEUDOSQUARES })
+  {
+    uint128_t start = (uint128_t) 1e19;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, 0, nullptr, false, engine);
+    std::cout << "pseudosquares_prime_sieve_parallel(10^19, 10^19+10^6, engine " << engine << ") = " << std::setw(7) << count;
+    check(count == pix_2[9]);
+  }
+
+  // [2^64 - 10^6, 2^64 + 10^6] is split between both engines
+  {
+    uint128_t start = ((uint128_t) 1 << 64) - (uint64_t) 1e6;
+    uint128_t stop = ((uint128_t) 1 << 64) + (uint64_t) 1e6;
+    uint128_t prev = 0;
+    uint64_t primes = 0;
+    bool OK = true;
+    auto sink = [&](const uint128_t* batch, std::size_t size) {
+      for (std::size_t i = 0; i < size; i++, primes++) {
+        OK &= (batch[i] > prev);
+        prev = batch[i];
+      }
+    };
+    uint64_t count1 = pseudosquares_prime_sieve_parallel(start, stop, 0, sink);
+    uint64_t count2 = pseudosquares_prime_sieve(start, stop);
+    std::cout << "pseudosquares_prime_sieve_parallel(2^64-10^6, 2^64+10^6) = " << std::setw(7) << count1;
+    check(OK && count1 == primes && count1 == count2);
+  }
+
+  // The sink receives the primes in increasing order
+  {
+    uint128_t start = (uint128_t) 1e17;
+    uint128_t prev = 0;
+    uint64_t primes = 0;
+    bool OK = true;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, 4,
+                       [&](const uint128_t* batch, std::size_t size) {
+                         for (std::size_t i = 0; i < size; i++, primes++) {
+                           OK &= (batch[i] > prev);
+                           prev = batch[i];
+                         }
+                       });
+    std::cout << "pseudosquares_prime_sieve_parallel(10^17, 10^17+10^6, sink) = " << std::setw(7) << count;
+    check(OK && count == primes && count == pix_2[7]);
+
+    uint256_t start256 = uint256_t(10000000000000000000ull) * 1000000;
+    count = pseudosquares_prime_sieve_parallel(start256, start256 + 1000000, 4);
+    std::cout << "pseudosquares_prime_sieve_parallel(10^25, 10^25+10^6) = " << std::setw(7) << count;
+    check(count == pix_2[15]);
+  }
+
+  // Pipeline mode: sieving and testing on different threads
+  for (int sieve_threads : { (int) PIPELINE_AUTO, 1, 2 })
+  {
+    set_pipeline(sieve_threads);
+    uint128_t start = (uint128_t) 1e21;
+    uint128_t prev = 0;
+    uint64_t primes = 0;
+    bool OK = true;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, 4,
+                       [&](const uint128_t* batch, std::size_t size) {
+                         for (std::size_t i = 0; i < size; i++, primes++) {
+                           OK &= (batch[i] > prev);
+                           prev = batch[i];
+                         }
+                       });
+    std::cout << "pseudosquares_prime_sieve_parallel(10^21, 10^21+10^6, pipeline " << sieve_threads << ") = " << std::setw(7) << count;
+    check(OK && count == primes && count == pix_2[11]);
+
+    uint256_t start256 = uint256_t(10000000000000000000ull) * 1000000;
+    count = pseudosquares_prime_sieve_parallel(start256, start256 + 1000000, 4);
+    std::cout << "pseudosquares_prime_sieve_parallel(10^25, 10^25+10^6) = " << std::setw(7) << count;
+    check(count == pix_2[15]);
+  }
+
+  set_pipeline(PIPELINE_OFF);
+
+  // Threads pinned to CPUs
+  for (Affinity affinity : { AFFINITY_CORES, AFFINITY_NUMA })
+  {
+    set_affinity(affinity);
+    uint128_t start = (uint128_t) 1e20;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, 4);
+    std::cout << "pseudosquares_prime_sieve_parallel(10^20, 10^20+10^6, affinity " << affinity << ") = " << std::setw(7) << count;
+    check(count == pix_2[10]);
+  }
+
+  set_affinity(AFFINITY_NONE);
+
+#if defined(__linux__)
+  // CPU quota of cgroup v2 and v1 directory trees
+  {
+    std::vector<std::string> dirs = { "cgroup_test", "cgroup_test/a", "cgroup_test/a/b",
+                                       "cgroup_test/cpu,cpuacct", "cgroup_test/cpu,cpuacct/docker" };
+    std::vector<std::string> files = { "cgroup_test/cgroup", "cgroup_test/a/cpu.max", "cgroup_test/a/b/cpu.max",
+                                       "cgroup_test/cpu,cpuacct/docker/cpu.cfs_quota_us",
+                                       "cgroup_test/cpu,cpuacct/docker/cpu.cfs_period_us" };
+    for (const std::string& dir : dirs)
+      mkdir(dir.c_str(), 0755);
+
+    std::ofstream("cgroup_test/cgroup") << "0::/a/b\n";
+    std::ofstream("cgroup_test/a/cpu.max") << "max 100000\n";
+    std::ofstream("cgroup_test/a/b/cpu.max") << "max 100000\n";
+    int unlimited = get_cgroup_cpu_limit("cgroup_test/cgroup", "cgroup_test");
+
+    std::ofstream("cgroup_test/a/b/cpu.max") << "1600000 100000\n";
+    int limit = get_cgroup_cpu_limit("cgroup_test/cgroup", "cgroup_test");
+
+    // The parent's quota is smaller
+    std::ofstream("cgroup_test/a/cpu.max") << "250000 100000\n";
+    int nested = get_cgroup_cpu_limit("cgroup_test/cgroup", "cgroup_test");
+
+    std::ofstream("cgroup_test/cgroup") << "4:cpu,cpuacct:/docker\n";
+    std::ofstream("cgroup_test/cpu,cpuacct/docker/cpu.cfs_quota_us") << "200000\n";
+    std::ofstream("cgroup_test/cpu,cpuacct/docker/cpu.cfs_period_us") << "100000\n";
+    int v1 = get_cgroup_cpu_limit("cgroup_test/cgroup", "cgroup_test");
+
+    std::ofstream("cgroup_test/cpu,cpuacct/docker/cpu.cfs_quota_us") << "-1\n";
+    int v1_unlimited = get_cgroup_cpu_limit("cgroup_test/cgroup", "cgroup_test");
+
+    for (const std::string& file : files)
+      std::remove(file.c_str());
+    for (auto dir = dirs.rbegin(); dir != dirs.rend(); dir++)
+      std::remove(dir->c_str());
+
+    std::cout << "get_cgroup_cpu_limit(v2 max, 16, nested 3, v1 2, v1 -1) = " << unlimited << ", " << limit << ", "
+              << nested << ", " << v1 << ", " << v1_unlimited;
+    check(unlimited == 0 && limit == 16 && nested == 3 && v1 == 2 && v1_unlimited == 0);
+  }
+#endif
+
+  // Default number of threads, one per physical CPU core
+  {
+    set_physical_cores(true);
+    uint128_t start = (uint128_t) 1e20;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6);
+    std::cout << "pseudosquares_prime_sieve_parallel(10^20, 10^20+10^6, physical cores) = " << std::setw(7) << count;
+    check(count == pix_2[10]);
+    set_physical_cores(false);
+  }
+
+  // Fit the threads, delta and s into a memory budget
+  {
+    set_max_memory(8 << 20);
+    uint128_t start = (uint128_t) 1e20;
+    uint64_t primes = 0;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, 4,
+                       [&](const uint128_t*, std::size_t size) { primes += size; });
+    std::cout << "pseudosquares_prime_sieve_parallel(10^20, 10^20+10^6, max memory 8 MiB) = " << std::setw(7) << count;
+    check(count == primes && count == pix_2[10]);
+
+    uint256_t start256 = uint256_t(10000000000000000000ull) * 1000000;
+    count = pseudosquares_prime_sieve_parallel(start256, start256 + 1000000, 4);
+    std::cout << "pseudosquares_prime_sieve_parallel(10^25, 10^25+10^6, max memory 8 MiB) = " << std::setw(7) << count;
+    check(count == pix_2[15]);
+
+    set_max_memory(1 << 10);
+    bool OK = true;
+
+    try {
+      pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, 4);
+    }
+    catch (const std::exception&) {
+      OK = false;
+    }
+
+    std::cout << "pseudosquares_prime_sieve_parallel(max memory 1 KiB)";
+    check(!OK);
+    set_max_memory(0);
+  }
+
+  // Performance counters, not permitted on many systems
+  {
+    std::string error;
+    bool enabled = enable_perf_counters(error);
+    uint128_t start = (uint128_t) 1e20;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, 4);
+    PerfCounts perf = get_perf_counts();
+    std::cout << "pseudosquares_prime_sieve_parallel(10^20, 10^20+10^6, perf counters " << (enabled ? "on" : "n/a") << ") = " << std::setw(7) << count;
+    check(count == pix_2[10] &&
+          enabled != !error.empty() &&
+          (!enabled || perf.counts[PERF_TEST][PERF_TASK_CLOCK] > 0));
+  }
+
+  // Chrome trace of the pipeline mode
+  {
+    enable_trace();
+    set_pipeline(PIPELINE_AUTO);
+    uint128_t start = (uint128_t) 1e21;
+    uint64_t primes = 0;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, 4,
+                       [&](const uint128_t*, std::size_t size) { primes += size; });
+    set_pipeline(PIPELINE_OFF);
+
+    const char* filename = "trace_test.json";
+    write_trace(filename);
+    std::ifstream file(filename);
+    std::stringstream json;
+    json << file.rdbuf();
+    file.close();
+    std::remove(filename);
+    std::string str = json.str();
+
+    std::cout << "write_trace(10^21, 10^21+10^6, pipeline) = " << std::setw(7) << count;
+    check(count == primes && count == pix_2[11] &&
+          str.find("{\"displayTimeUnit\"") == 0 &&
+          str.find("\"name\":\"setup\"") != std::string::npos &&
+          str.find("\"name\":\"test\"") != std::string::npos &&
+          str.find("\"name\":\"output\"") != std::string::npos &&
+          str.rfind("]}\n") == str.size() - 3);
+  }
+  std::cout << std::endl;
+
+  // Freed blocks are recycled by the thread's arena
+  {
+    std::size_t bytes = 3 << 20;
+    void* ptr1 = arena_allocate(bytes);
+    arena_deallocate(ptr1, bytes);
+    void* ptr2 = arena_allocate(bytes - 100);
+    bool aligned = ((uintptr_t) ptr2) % (2 << 20) == 0;
+    std::cout << "arena_allocate(3 MiB) huge page aligned & recycled";
+    check(ptr1 == ptr2 && aligned);
+    arena_deallocate(ptr2, bytes - 100);
+  }
+  std::cout << std::endl;
+
+  // Non-default tuning parameters of a host profile
+  {
+    const char* profile_file = "pseudosquares_tests_profile.txt";
+    HostProfile profile;
+    profile.cpu = "test CPU";
+    profile.bands.push_back(ProfileBand{ 1e22, 32 << 10, 2e4, false });
+    profile.bands.push_back(ProfileBand{ 1e300, 1 << 20, 1e4, true });
+    write_profile(profile_file, profile);
+    HostProfile profile2 = read_profile(profile_file);
+    std::remove(profile_file);
+
+    std::cout << "read_profile(write_profile(profile))";
+    check(profile2.cpu == profile.cpu &&
+          profile2.bands.size() == 2 &&
+          profile2.bands[0].max_stop == 1e22 &&
+          profile2.bands[0].sieve_size == (32 << 10) &&
+          profile2.bands[0].min_thread_dist == 2e4 &&
+          !profile2.bands[0].avx512_ifma &&
+          profile2.bands[1].avx512_ifma);
+
+    set_host_profile(profile2.bands);
+    uint128_t start = (uint128_t) 1e20;
+    uint64_t count = pseudosquares_prime_sieve_parallel(start, start + (uint64_t) 1e6, 0, nullptr, false, ENGINE_PSEUDOSQUARES);
+    std::cout << "pseudosquares_prime_sieve_parallel(10^20, 10^20+10^6, host profile) = " << std::setw(7) << count;
+    check(count == pix_2[10]);
+
+    PseudosquaresSieve sieve;
+    count = sieve.count(start * 100000, start * 100000 + (uint64_t) 1e6);
+    std::cout << "PseudosquaresSieve::count(10^25, 10^25+10^6, host profile) = " << std::setw(7) << count;
+    check(count == pix_2[15]);
+    set_host_profile({});
+  }
+  std::cout << std::endl;
+
+  // Sieve 4 shards of [10^12, 10^12+10^7] and merge the records
+  {
+    uint128_t start = (uint128_t) 1e12;
+    uint128_t stop = start + (uint64_t) 1e7;
+    ShardResult total;
+    pseudosquares_prime_sieve_parallel(start, stop, 0,
+      [&](const uint128_t* primes, std::size_t size) { total.add_digest(primes, size); });
+
+    std::stringstream records;
+    uint64_t primes = 0;
+
+    for (uint64_t i = 0; i < 4; i++)
+    {
+      ShardResult shard = get_shard(start, stop, i, 4);
+      shard.primes = pseudosquares_prime_sieve_parallel((uint128_t) shard.start, (uint128_t) shard.stop, 0,
+        [&](const uint128_t* p, std::size_t size) { shard.add_digest(p, size); });
+      std::cout << "shard=" << i << "/4 [" << shard.start << ", " << shard.stop << "] = " << std::setw(6) << shard.primes;
+      check(shard.start <= shard.stop && (i == 0 || shard.start % uint64_t(1 << 20) == 0));
+      primes += shard.primes;
+      records << "Primes: " << shard.primes << "\n" << to_string(shard) << "\n";
+    }
+
+    std::vector<ShardResult> shards = read_shards(records);
+    ShardResult merged = merge_shards(shards);
+    std::cout << "merge_shards(4 shards) = " << merged.primes;
+    check(merged.primes == primes &&
+          merged.sum == total.sum &&
+          merged.hash == total.hash &&
+          merged.start == start &&
+          merged.stop == stop);
+
+    shards.erase(shards.begin() + 2);
+    bool OK = true;
+
+    try {
+      merge_shards(shards);
+    }
+    catch (const std::exception&) {
+      OK = false;
+    }
+
+    std::cout << "merge_shards(missing shard)";
+    check(!OK);
+  }
+
+  // [0, 10^6] is smaller than 4 * 2^20, 3 shards are empty
+  {
+    uint128_t stop = (uint128_t) 1e6;
+    std::vector<ShardResult> shards;
+    bool OK = true;
+
+    for (uint64_t i = 0; i < 4; i++)
+    {
+      ShardResult shard = get_shard(0, stop, i, 4);
+      OK &= (shard.stop <= stop);
+      if (shard.start <= shard.stop)
+        shard.primes = pseudosquares_prime_sieve_parallel((uint128_t) shard.start, (uint128_t) shard.stop);
+      shards.push_back(shard);
+    }
+
+    ShardResult merged = merge_shards(shards);
+    std::cout << "merge_shards(4 shards of [0, 10^6]) = " << merged.primes;
+    check(OK && merged.primes == pix[5]);
+  }
+  std::cout << std::endl;
+
+  // Fermat's little theorem for primes > 2^128:
+  // 2^130 - 5, 2^192 - 2^64 - 1, 2^224 - 2^96 + 1
+  const uint256_t one = 1;
+  const uint256_t big_primes[3] =
+  {
+    (one << 130) - 5,
+    (one << 192) - (one << 64) - 1,
+    (one << 224) - (one << 96) + 1
+  };
+
+  for (const uint256_t& n : big_primes)
+  {
+    for (uint64_t base : { 2, 3, 5, 7 })
+    {
+      uint256_t res = modpow(base, n - 1, n);
+      std::cout << base << "^(n-1) mod n = " << res << " with n = " << n;
+      check(res == 1);
+    }
+
+    // n + 2 is composite
+    uint256_t res = modpow(3, n + 1, n + 2);
+    std::cout << "3^(n+1) mod (n+2) = " << res;
+    check(res != 1);
+  }
+
+  std::cout << std::endl;
+
+  // Compare MontgomeryWide with the 128-bit implementation
+  for (uint128_t m = 1000003; m < ((uint128_t) 1 << 125); m = m * 7 + 2)
+  {
+    uint128_t e = m - m / 3;
+    MontgomeryWide<3> mf{uint192_t(m)};
+    uint128_t res1 = modpow(11, e, m);
+    uint128_t res2 = (uint128_t) mf.convert_out(mf.pow(mf.convert_in(11), uint192_t(e)));
+    uint128_t res3 = (uint128_t) mf.convert_out(mf.two_pow(uint192_t(e)));
+    std::cout << "MontgomeryWide<3>(" << m << ")";
+    check(res1 == res2 && res3 == modpow<2>(e, m));
+  }
+
+  std::cout << std::endl;
+
+  // Compare mod_u64 with the generic modulo operator
+  for (uint64_t d : { 3ull, 1000003ull, 4294967291ull, 18446744073709551557ull })
+  {
+    uint128_t n = ((uint128_t) 1 << 125) / 3;
+    uint256_t m = (uint256_t(n) << 120) + 12345;
+    std::cout << "mod_u64(n, " << d << ") = " << mod_u64(n, d);
+    check(mod_u64(n, d) == n % d && mod_u64(m, d) == (uint64_t) (m % d));
+  }
+
+  std::cout << std::endl;
+
+  // Compare modpow_batch (uses SIMD if supported by the CPU)
+  // with modpow. The batch contains moduli of all sizes.
+  {
+    std::vector<uint128_t> exponents;
+    std::vector<uint128_t> moduli;
+
+    for (uint128_t m = 1000003; m < ((uint128_t) 1 << 125); m = m * 7 + 2)
+    {
+      moduli.push_back(m);
+      exponents.push_back((m - 1) >> 1);
+    }
+
+    for (uint64_t base : { 2, 3, 373 })
+    {
+      std::vector<uint128_t> res(moduli.size());
+      modpow_batch(base, exponents.data(), moduli.data(), res.data(), moduli.size());
+      bool OK = true;
+
+      for (std::size_t i = 0; i < moduli.size(); i++)
+      {
+        uint128_t res2 = (base == 2) ? modpow<2>(exponents[i], moduli[i])
+                                     : modpow(base, exponents[i], moduli[i]);
+        OK &= (res[i] == res2);
+      }
+
+      std::cout << "modpow_batch(" << base << ", " << moduli.size() << " moduli)";
+      check(OK);
+    }
+  }
+
+  std::cout << std::endl;
+
+  // Known pseudosquares may be restated
+  bool OK = load_pseudosquares_file("# p Lp\n367 3655334429477057460046489\n373 4235025223080597503519329\n");
+  std::cout << "load_pseudosquares(L367, L373)";
+  check(OK);
+
+  // L379 is not a quadratic residue modulo 3
+  OK = load_pseudosquares_file("379 4235025223080597503519337\n");
+  std::cout << "load_pseudosquares(invalid L379)";
+  check(!OK);
+
+  // L383 requires L379
+  OK = load_pseudosquares_file("383 5000000000000000000000001\n");
+  std::cout << "load_pseudosquares(missing L379)";
+  check(!OK);
+
+  // n / s < max(Lp) with Lp < 2^126 and s < 2^32
+  try {
+    uint256_t start = uint256_t(1) << 158;
+    pseudosquares_prime_sieve(start, start + 100);
+    OK = true;
+  }
+  catch (const std::exception&) {
+    OK = false;
+  }
+
+  std::cout << "pseudosquares_prime_sieve(2^158, 2^158+100)";
+  check(!OK);
+
+  std::cout << std::endl;
+
+  // The 1st call creates the sieving primes cache
+  // file, the 2nd call memory maps the existing file.
+  const char* sieving_primes_file = "sieving_primes_test.bin";
+  std::remove(sieving_primes_file);
+
+  for (int i = 0; i < 2; i++)
+  {
+    load_sieving_primes(sieving_primes_file, 1 << 22);
+
+    for (std::size_t k : { 0, 10 })
+    {
+      uint128_t start = (uint128_t) 1e10;
+      for (std::size_t j = 0; j < k; j++)
+        start *= 10;
+      uint64_t count = pseudosquares_prime_sieve(start, start + (uint64_t) 1e6);
+      std::cout << "PrimePi(10^" << k + 10 << ", 10^" << k + 10 << "+10^6) = " << std::setw(7) << count << " (sieving primes file)";
+      check(count == pix_2[k]);
+    }
+  }
+
+  std::remove(sieving_primes_file);
+  std::ofstream(sieving_primes_file) << "invalid";
+  OK = true;
+
+  try {
+    load_sieving_primes(sieving_primes_file);
+  }
+  catch (const std::exception&) {
+    OK = false;
+  }
+
+  std::remove(sieving_primes_file);
+  std::cout << "load_sieving_primes(invalid file)";
+  check(!OK);
+
   std::cout << std::endl;
   std::cout << "All tests passed successfully!" << std::endl;
 
@@ -0,0 +1,150 @@
+///
+/// @file  trace.cpp
+/// @brief Each thread records its spans into its own ring buffer,
+///        hence recording requires no locking. If a thread
+///        records more than max_spans spans, its oldest spans are
+///        overwritten. The buffers are kept until the trace is
+///        written, even if their threads have exited.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#include "trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// 24 bytes per span, 1.5 MiB per thread
+const std::size_t max_spans = 1 << 16;
+
+struct Span
+{
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+class TraceBuffer
+{
+public:
+    TraceBuffer()
+        : spans_(max_spans)
+    { }
+
+    void add(const Span& span)
+    {
+        std::size_t size = size_.load(std::memory_order_relaxed);
+        spans_[size % max_spans] = span;
+        size_.store(size + 1, std::memory_order_release);
+    }
+
+    /// The recorded spans in chronological order
+    std::vector<Span> spans() const
+    {
+        std::size_t size = size_.load(std::memory_order_acquire);
+        std::size_t first = (size > max_spans) ? size - max_spans : 0;
+        std::vector<Span> spans;
+
+        for (std::size_t i = first; i < size; i++)
+            spans.push_back(spans_[i % max_spans]);
+
+        return spans;
+    }
+
+private:
+    std::vector<Span> spans_;
+    std::atomic<std::size_t> size_{0};
+};
+
+std::atomic<bool> enabled(false);
+std::chrono::steady_clock::time_point start_time;
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+/// The index of the thread's buffer is its tid in the trace
+TraceBuffer& get_trace_buffer()
+{
+    thread_local TraceBuffer* buffer = nullptr;
+
+    if (!buffer)
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffers.emplace_back(new TraceBuffer);
+        buffer = buffers.back().get();
+    }
+
+    return *buffer;
+}
+
+} // namespace
+
+void enable_trace()
+{
+    start_time = std::chrono::steady_clock::now();
+    get_trace_buffer();
+    enabled = true;
+}
+
+bool trace_enabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t trace_now()
+{
+    auto ns = std::chrono::steady_clock::now() - start_time;
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(ns).count();
+}
+
+void trace_span(const char* name, uint64_t begin, uint64_t end)
+{
+    get_trace_buffer().add(Span{name, begin, end});
+}
+
+void write_trace(const std::string& filename)
+{
+    std::ofstream file(filename);
+
+    if (!file)
+        throw std::runtime_error("trace: failed to create " + filename);
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    file << std::fixed << std::setprecision(3);
+    bool first = true;
+
+    for (std::size_t tid = 0; tid < buffers.size(); tid++)
+    {
+        std::string name = (tid == 0) ? "main" : "worker " + std::to_string(tid);
+        file << (first ? "" : ",\n")
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+             << ",\"args\":{\"name\":\"" << name << "\"}}";
+        first = false;
+
+        // Chrome trace timestamps are in microseconds
+        for (const Span& span : buffers[tid]->spans())
+            file << ",\n{\"name\":\"" << span.name
+                 << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                 << ",\"ts\":" << span.begin / 1e3
+                 << ",\"dur\":" << (span.end - span.begin) / 1e3 << "}";
+    }
+
+    file << "\n]}\n";
+
+    if (!file.flush())
+        throw std::runtime_error("trace: failed to write " + filename);
+}
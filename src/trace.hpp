@@ -0,0 +1,72 @@
+///
+/// @file  trace.hpp
+/// @brief Timeline of the work of each thread (sieving primes
+///        setup, the sieve, extract and test phases of each
+///        segment, queue waits, output), see --trace=FILE.
+///        The spans are written in the Chrome trace event
+///        format which can be viewed using ui.perfetto.dev
+///        or chrome://tracing.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <stdint.h>
+#include <string>
+
+/// Record the spans of all threads from now on, the
+/// calling thread is named "main" in the trace.
+///
+void enable_trace();
+bool trace_enabled();
+
+/// Write the recorded spans as Chrome trace JSON.
+/// Must not be called while sieving.
+///
+void write_trace(const std::string& filename);
+
+/// Nanoseconds since enable_trace()
+uint64_t trace_now();
+
+/// name must be a string literal
+void trace_span(const char* name, uint64_t begin, uint64_t end);
+
+namespace {
+
+/// Records a span of the current thread
+/// during the lifetime of TraceScope.
+///
+class TraceScope
+{
+public:
+    TraceScope(const char* name)
+        : name_(name),
+          enabled_(trace_enabled())
+    {
+        if (enabled_)
+            begin_ = trace_now();
+    }
+
+    ~TraceScope()
+    {
+        if (enabled_)
+            trace_span(name_, begin_, trace_now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    uint64_t begin_ = 0;
+    bool enabled_;
+};
+
+} // namespace
+
+#endif
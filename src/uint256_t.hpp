@@ -0,0 +1,463 @@
+///
+/// @file   uint256_t.hpp
+/// @brief  Fixed-width unsigned integers with N 64-bit words.
+///         WideUint<N> is used to sieve primes > 2^126 which
+///         is the limit of our 128-bit implementation. It
+///         supports all operators required by the sieve, by
+///         Montgomery arithmetic and by the calculator.hpp
+///         expression parser.
+///
+/// Copyright (C) 2025 Kim Walisch, <kim.walisch@gmail.com>
+///
+/// This file is distributed under the BSD License. See the COPYING
+/// file in the top level directory.
+///
+
+#ifndef UINT256_T_HPP
+#define UINT256_T_HPP
+
+#include "int128_t.hpp"
+#include "macros.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+
+template <std::size_t N>
+class WideUint
+{
+    static_assert(N >= 2, "WideUint<N> requires N >= 2");
+
+    template <typename T>
+    using EnableIfInteger = typename std::enable_if<
+        (std::is_integral<T>::value ||
+         std::is_same<T, int128_t>::value ||
+         std::is_same<T, uint128_t>::value) &&
+        !std::is_same<T, bool>::value, int>::type;
+
+public:
+    constexpr WideUint()
+        : words_{}
+    { }
+
+    /// Conversion from built-in integers, negative
+    /// numbers are sign extended (like for unsigned
+    /// built-in integer types).
+    template <typename T, EnableIfInteger<T> = 0>
+    constexpr WideUint(T n)
+        : words_{}
+    {
+        uint128_t x = (uint128_t) n;
+        words_[0] = (uint64_t) x;
+        words_[1] = (uint64_t) (x >> 64);
+
+        bool is_negative = (std::is_signed<T>::value ||
+                            std::is_same<T, int128_t>::value) && (x >> 127);
+        if (is_negative)
+            for (std::size_t i = 2; i < N; i++)
+                words_[i] = ~uint64_t(0);
+    }
+
+    /// Truncating or zero extending conversion
+    template <std::size_t M>
+    constexpr explicit WideUint(const WideUint<M>& n)
+        : words_{}
+    {
+        for (std::size_t i = 0; i < std::min(N, M); i++)
+            words_[i] = n.word(i);
+    }
+
+    /// Truncating conversion to built-in integers
+    template <typename T, EnableIfInteger<T> = 0>
+    constexpr explicit operator T() const
+    {
+        return (T) ((uint128_t(words_[1]) << 64) | words_[0]);
+    }
+
+    constexpr explicit operator bool() const
+    {
+        for (std::size_t i = 0; i < N; i++)
+            if (words_[i])
+                return true;
+        return false;
+    }
+
+    explicit operator double() const
+    {
+        double x = 0;
+        for (std::size_t i = N; i-- > 0;)
+            x = x * 18446744073709551616.0 + (double) words_[i];
+        return x;
+    }
+
+    static constexpr std::size_t words()
+    {
+        return N;
+    }
+
+    static constexpr std::size_t bits()
+    {
+        return N * 64;
+    }
+
+    static constexpr WideUint max()
+    {
+        return ~WideUint();
+    }
+
+    constexpr uint64_t word(std::size_t i) const
+    {
+        return words_[i];
+    }
+
+    constexpr uint64_t& word(std::size_t i)
+    {
+        return words_[i];
+    }
+
+    /// Returns true if the number fits into the
+    /// lower M words.
+    constexpr bool fits_words(std::size_t M) const
+    {
+        for (std::size_t i = M; i < N; i++)
+            if (words_[i])
+                return false;
+        return true;
+    }
+
+    /// Number of significant bits
+    constexpr std::size_t bit_length() const
+    {
+        for (std::size_t i = N; i-- > 0;)
+        {
+            if (words_[i])
+            {
+                std::size_t bits = 0;
+                for (uint64_t w = words_[i]; w; w >>= 1)
+                    bits++;
+                return i * 64 + bits;
+            }
+        }
+
+        return 0;
+    }
+
+    friend constexpr bool operator==(const WideUint& x, const WideUint& y)
+    {
+        for (std::size_t i = 0; i < N; i++)
+            if (x.words_[i] != y.words_[i])
+                return false;
+        return true;
+    }
+
+    friend constexpr bool operator!=(const WideUint& x, const WideUint& y)
+    {
+        return !(x == y);
+    }
+
+    friend constexpr bool operator<(const WideUint& x, const WideUint& y)
+    {
+        for (std::size_t i = N; i-- > 0;)
+            if (x.words_[i] != y.words_[i])
+                return x.words_[i] < y.words_[i];
+        return false;
+    }
+
+    friend constexpr bool operator>(const WideUint& x, const WideUint& y)
+    {
+        return y < x;
+    }
+
+    friend constexpr bool operator<=(const WideUint& x, const WideUint& y)
+    {
+        return !(y < x);
+    }
+
+    friend constexpr bool operator>=(const WideUint& x, const WideUint& y)
+    {
+        return !(x < y);
+    }
+
+    constexpr WideUint& operator+=(const WideUint& y)
+    {
+        uint64_t carry = 0;
+
+        for (std::size_t i = 0; i < N; i++)
+        {
+            uint128_t sum = (uint128_t) words_[i] + y.words_[i] + carry;
+            words_[i] = (uint64_t) sum;
+            carry = (uint64_t) (sum >> 64);
+        }
+
+        return *this;
+    }
+
+    constexpr WideUint& operator-=(const WideUint& y)
+    {
+        uint64_t borrow = 0;
+
+        for (std::size_t i = 0; i < N; i++)
+        {
+            uint128_t diff = (uint128_t) words_[i] - y.words_[i] - borrow;
+            words_[i] = (uint64_t) diff;
+            borrow = (uint64_t) (diff >> 64) & 1;
+        }
+
+        return *this;
+    }
+
+    /// Truncating multiplication (mod 2^(64*N))
+    constexpr WideUint& operator*=(const WideUint& y)
+    {
+        WideUint res;
+
+        for (std::size_t i = 0; i < N; i++)
+        {
+            uint64_t carry = 0;
+
+            for (std::size_t j = 0; i + j < N; j++)
+            {
+                uint128_t p = (uint128_t) words_[i] * y.words_[j] + res.words_[i + j] + carry;
+                res.words_[i + j] = (uint64_t) p;
+                carry = (uint64_t) (p >> 64);
+            }
+        }
+
+        *this = res;
+        return *this;
+    }
+
+    constexpr WideUint& operator/=(const WideUint& y)
+    {
+        WideUint rem;
+        divmod(*this, y, *this, rem);
+        return *this;
+    }
+
+    constexpr WideUint& operator%=(const WideUint& y)
+    {
+        WideUint quotient;
+        divmod(*this, y, quotient, *this);
+        return *this;
+    }
+
+    constexpr WideUint& operator&=(const WideUint& y)
+    {
+        for (std::size_t i = 0; i < N; i++)
+            words_[i] &= y.words_[i];
+        return *this;
+    }
+
+    constexpr WideUint& operator|=(const WideUint& y)
+    {
+        for (std::size_t i = 0; i < N; i++)
+            words_[i] |= y.words_[i];
+        return *this;
+    }
+
+    constexpr WideUint& operator^=(const WideUint& y)
+    {
+        for (std::size_t i = 0; i < N; i++)
+            words_[i] ^= y.words_[i];
+        return *this;
+    }
+
+    constexpr WideUint& operator<<=(std::size_t shift)
+    {
+        if (shift >= bits())
+            return *this = WideUint();
+
+        std::size_t w = shift / 64;
+        std::size_t b = shift % 64;
+
+        for (std::size_t i = N; i-- > 0;)
+        {
+            uint64_t hi = (i >= w) ? words_[i - w] : 0;
+            uint64_t lo = (i >= w + 1) ? words_[i - w - 1] : 0;
+            words_[i] = (b == 0) ? hi : (hi << b) | (lo >> (64 - b));
+        }
+
+        return *this;
+    }
+
+    constexpr WideUint& operator>>=(std::size_t shift)
+    {
+        if (shift >= bits())
+            return *this = WideUint();
+
+        std::size_t w = shift / 64;
+        std::size_t b = shift % 64;
+
+        for (std::size_t i = 0; i < N; i++)
+        {
+            uint64_t lo = (i + w < N) ? words_[i + w] : 0;
+            uint64_t hi = (i + w + 1 < N) ? words_[i + w + 1] : 0;
+            words_[i] = (b == 0) ? lo : (lo >> b) | (hi << (64 - b));
+        }
+
+        return *this;
+    }
+
+    constexpr WideUint& operator<<=(const WideUint& shift)
+    {
+        return *this <<= shift.shift_amount();
+    }
+
+    constexpr WideUint& operator>>=(const WideUint& shift)
+    {
+        return *this >>= shift.shift_amount();
+    }
+
+    constexpr WideUint& operator++()
+    {
+        return *this += 1;
+    }
+
+    constexpr WideUint& operator--()
+    {
+        return *this -= 1;
+    }
+
+    friend constexpr WideUint operator+(WideUint x, const WideUint& y) { return x += y; }
+    friend constexpr WideUint operator-(WideUint x, const WideUint& y) { return x -= y; }
+    friend constexpr WideUint operator*(WideUint x, const WideUint& y) { return x *= y; }
+    friend constexpr WideUint operator/(WideUint x, const WideUint& y) { return x /= y; }
+    friend constexpr WideUint operator%(WideUint x, const WideUint& y) { return x %= y; }
+    friend constexpr WideUint operator&(WideUint x, const WideUint& y) { return x &= y; }
+    friend constexpr WideUint operator|(WideUint x, const WideUint& y) { return x |= y; }
+    friend constexpr WideUint operator^(WideUint x, const WideUint& y) { return x ^= y; }
+    friend constexpr WideUint operator<<(WideUint x, std::size_t shift) { return x <<= shift; }
+    friend constexpr WideUint operator>>(WideUint x, std::size_t shift) { return x >>= shift; }
+    friend constexpr WideUint operator<<(WideUint x, const WideUint& shift) { return x <<= shift; }
+    friend constexpr WideUint operator>>(WideUint x, const WideUint& shift) { return x >>= shift; }
+
+    friend constexpr WideUint operator~(WideUint x)
+    {
+        for (std::size_t i = 0; i < N; i++)
+            x.words_[i] = ~x.words_[i];
+        return x;
+    }
+
+    friend constexpr WideUint operator-(const WideUint& x)
+    {
+        return WideUint() - x;
+    }
+
+    /// Unsigned division: quotient = x / y, rem = x % y.
+    /// Single word divisors (e.g. low % prime in the sieve)
+    /// use a fast path, other divisors use binary long
+    /// division which is only used outside of hot loops.
+    ///
+    static constexpr void divmod(const WideUint& x,
+                                 const WideUint& y,
+                                 WideUint& quotient,
+                                 WideUint& rem)
+    {
+        ASSERT(y != 0);
+
+        if (y.fits_words(1))
+        {
+            uint64_t d = y.words_[0];
+            uint64_t r = 0;
+            WideUint q;
+
+            for (std::size_t i = N; i-- > 0;)
+            {
+                uint128_t cur = (uint128_t(r) << 64) | x.words_[i];
+                q.words_[i] = (uint64_t) (cur / d);
+                r = (uint64_t) (cur % d);
+            }
+
+            quotient = q;
+            rem = r;
+            return;
+        }
+
+        WideUint q;
+        WideUint r;
+
+        for (std::size_t i = x.bit_length(); i-- > 0;)
+        {
+            r <<= 1;
+            r.words_[0] |= (x.words_[i / 64] >> (i % 64)) & 1;
+
+            if (r >= y)
+            {
+                r -= y;
+                q.words_[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+
+        quotient = q;
+        rem = r;
+    }
+
+private:
+    uint64_t words_[N];
+
+    constexpr std::size_t shift_amount() const
+    {
+        return fits_words(1) ? (std::size_t) std::min(words_[0], (uint64_t) bits()) : bits();
+    }
+};
+
+using uint192_t = WideUint<3>;
+using uint256_t = WideUint<4>;
+
+/// n % d using one 64-bit reduction per word,
+/// see mod_u64() in int128_t.hpp.
+///
+template <std::size_t N>
+ALWAYS_INLINE uint64_t mod_u64(const WideUint<N>& n, uint64_t d)
+{
+    uint64_t r = 0;
+    for (std::size_t i = N; i-- > 0;)
+        r = mod_u64(r, n.word(i), d);
+    return r;
+}
+
+template <std::size_t N>
+inline std::string to_string(WideUint<N> n)
+{
+    std::string str;
+
+    // Extract 19 decimal digits at a time
+    const uint64_t pow10_19 = 10000000000000000000ull;
+
+    while (!n.fits_words(1))
+    {
+        WideUint<N> q, r;
+        WideUint<N>::divmod(n, pow10_19, q, r);
+        uint64_t digits = (uint64_t) r;
+
+        for (int i = 0; i < 19; i++)
+        {
+            str += char('0' + digits % 10);
+            digits /= 10;
+        }
+
+        n = q;
+    }
+
+    for (uint64_t x = (uint64_t) n; x > 0; x /= 10)
+        str += char('0' + x % 10);
+
+    if (str.empty())
+        str = "0";
+
+    std::reverse(str.begin(), str.end());
+
+    return str;
+}
+
+template <std::size_t N>
+inline std::ostream& operator<<(std::ostream& stream, const WideUint<N>& n)
+{
+    stream << to_string(n);
+    return stream;
+}
+
+#endif